@@ -129,6 +129,20 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf for a block whose old contents are of no
+// interest (e.g. one that was just allocated), zeroed in the cache
+// instead of being read from the disk.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  memset(b->data, 0, BSIZE);
+  b->valid = 1;
+  return b;
+}
+
 // Write b's contents to disk.  `Buffer must be locked.`
 void
 bwrite(struct buf *b)
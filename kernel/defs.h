@@ -1,17 +1,22 @@
 struct buf;
 struct context;
 struct file;
+struct files;
 struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
+struct dcachestat;
+struct sleepstat;
 struct superblock;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
@@ -24,6 +29,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,20 +39,26 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepread(struct file*, uint64, int n, uint off);
+int             filepwrite(struct file*, uint64, int n, uint off);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
+void            dcstat(struct dcachestat*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
@@ -62,19 +74,52 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+uint64          kfreemem(void);
 void            kinit(void);
+void            kref(void *);
+int             krefcnt(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+int             begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
+
+// mmap.c
+void            textinit(void);
+void            textinval(struct inode*);
+int             textreclaim(void);
+struct vma*     vmalookup(struct proc*, uint64);
+struct seg*     seglookup(struct proc*, uint64);
+void            segtrim(struct proc*);
+uint64          mmapbase(struct proc*);
+int             vmfault(struct proc*, uint64, int);
+void            vmprefault(struct proc*, uint64, uint64);
+int             munmap(struct proc*, uint64, uint64);
+void            vmafree(struct proc*);
+int             vmacopy(struct proc*, struct proc*);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             piperesize(struct pipe*, int);
+
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
+// sem.c
+void            seminit(void);
+struct sem*     semget(char*, int);
+void            semput(struct sem*);
+int             semwait(struct sem*);
+void            sempost(struct sem*);
 
 // printf.c
 void            printf(char*, ...);
@@ -85,6 +130,14 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, struct file**);
+int             filesgrow(struct files*);
+int             vfork(void);
+void            vforkdone(struct proc*, pagetable_t);
+int             clone(uint64, uint64, uint64, uint64);
+int             futex(uint64, int, int);
+void            killthreads(struct proc*);
+void            wakeproc(struct proc*, void*);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -119,6 +172,9 @@ void            pop_off(void);
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
+void            sleeplockstat(struct sleepstat*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -131,6 +187,10 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// sysfile.c
+struct file*    fdget(int);
+void            ringfree(struct proc*, pagetable_t);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -154,6 +214,7 @@ void            uartputc_sync(int);
 int             uartgetc(void);
 
 // vm.c
+pte_t *         walk(pagetable_t, uint64, int);
 void            kvminit(void);
 void            kvminithart(void);
 uint64          kvmpa(uint64);
@@ -164,9 +225,12 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+uint64          uvmtake(pagetable_t, uint64);
+int             uvmgive(pagetable_t, uint64, uint64, uint64*);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
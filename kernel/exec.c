@@ -4,26 +4,43 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
-
 // 两种执行流
 // 1. initcode --> exec("/init") --> (syscall)exec()  <the first process>
 // 2. fork --> exec
 // 3. others' invoking directly
 int
 exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
+// Replace p's memory with the program at path, looked up
+// from the current process's directory. p is the current
+// process, or a new one that spawn() is setting up. Only a
+// process's first thread can exec(); the others are killed
+// once the new program has loaded.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, n, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct seg seg[NSEG];
+  struct inode *exe = 0, *oldexe;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  uint64 oldsz;
+
+  if(p->thread)
+    return -1;
 
   begin_op();
 
@@ -33,7 +50,7 @@ exec(char *path, char **argv)
     end_op();
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
 
   // 检查ELF文件合法性
   // Check ELF header
@@ -49,32 +66,44 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
-  for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
+  // Record the program's segments; vmfault() reads their
+  // pages in from ip as the program touches them.
+  memset(seg, 0, sizeof(seg));
+  for(i=0, n=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
     if(ph.type != ELF_PROG_LOAD)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz >= TRAPFRAME)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
-    sz = sz1;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    // segments must be in address order and not share pages.
+    if(ph.vaddr < sz || n == NSEG)
+      goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
+    seg[n].addr = ph.vaddr;
+    seg[n].len = ph.memsz;
+    seg[n].filesz = ph.filesz;
+    seg[n].off = ph.off;
+    seg[n].perm = PTE_U;
+    if(ph.flags & ELF_PROG_FLAG_READ)
+      seg[n].perm |= PTE_R;
+    if(ph.flags & ELF_PROG_FLAG_WRITE)
+      seg[n].perm |= PTE_W;
+    if(ph.flags & ELF_PROG_FLAG_EXEC)
+      seg[n].perm |= PTE_X;
+    n++;
+    sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  iunlockshared(ip);
   end_op();
+  exe = ip;   // keep a reference for vmfault()
   ip = 0;
 
-  p = myproc();
-  uint64 oldsz = p->sz;
-
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   // 两个PGSIZE大小 一个用作guard page(防止stack overflow伤及其他区域) 一个用于用户栈()
@@ -124,12 +153,29 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  killthreads(p);
+  vmafree(p);
   oldpagetable = p->pagetable;
+  oldsz = p->mm->sz;
   p->pagetable = pagetable;
-  p->sz = sz;   // 进程exec后用户空间(不计算trapframe and trampoline)初始大小为栈底地址值
+  p->mm->sz = sz;   // 进程exec后用户空间(不计算trapframe and trampoline)初始大小为栈底地址值
+  p->mm->heap = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main       // 用户态PC(用户态program counter 指向正在执行的指令)
   p->trapframe->sp = sp; // initial stack pointer     // 在args参数之后
-  proc_freepagetable(oldpagetable, oldsz);            // fork旧进程复制过来的虚拟地址空间被释放
+  memmove(p->mm->seg, seg, sizeof(seg));
+  oldexe = p->mm->exe;
+  p->mm->exe = exe;
+  if(p->mm->ring)
+    ringfree(p, oldpagetable);   // the new image starts without queues
+  if(p->vfork)
+    vforkdone(p, oldpagetable);   // the parent's memory, borrowed since vfork()
+  else
+    proc_freepagetable(oldpagetable, oldsz);            // fork旧进程复制过来的虚拟地址空间被释放
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -137,36 +183,14 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
     end_op();
   }
-  return -1;
-}
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  if((va % PGSIZE) != 0)
-    panic("loadseg: va must be page aligned");
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
   }
-  
-  return 0;
+  return -1;
 }
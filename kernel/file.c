@@ -8,38 +8,26 @@
 #include "param.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
 
-struct logheader {
-  int n;   // counter: 修改的struct buf块数(未写入disk上data block的block数 在commit后置0)
-  int block[LOGSIZE];  // 修改的struct buf块对应的扇区号数组
-};
-
-struct log {
-  struct spinlock lock;
-  int start;       // logstart
-  int size;        // Number of log blocks (struct superlog.nlog)
-  int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
-  int dev;
-  struct logheader lh;
-};
-
-extern struct log log;
-
 struct devsw devsw[NDEV];
+// File structures come from a slab cache, so the number
+// open is limited only by memory. ftable.lock protects
+// their reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "filecache", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -48,16 +36,12 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;   // 可以通过fork dup增加
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  initsleeplock(&f->offlock, "offlock");
+  f->ref = 1;   // 可以通过fork dup增加
+  return f;
 }
 
 // Increment ref count for file f.
@@ -89,9 +73,12 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
+  } else if(ff.type == FD_SEM){
+    semput(ff.sem);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
     begin_op();
     iput(ff.ip);
@@ -108,9 +95,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -123,22 +110,31 @@ filestat(struct file *f, uint64 addr)
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  int r = 0, shared;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, 0);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)     // 设备被当做文件处理(因此这里有读写设备文件)
       return -1;
+    vmprefault(myproc(), addr, n);    // device drivers copy with their lock held
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
+    // readers of the inode share its lock, so two reads that
+    // could both be using f->off take turns on it instead.
+    shared = f->ref > 1 || myproc()->files->ref > 1;
+    vmprefault(myproc(), addr, n);    // addr may be mapped from f->ip itself
+    if(shared)
+      acquiresleep(&f->offlock);
+    ilockshared(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
-    iunlock(f->ip);
+    iunlockshared(f->ip);
+    if(shared)
+      releasesleep(&f->offlock);
   } else {
     panic("fileread");
   }
@@ -146,63 +142,71 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Write n bytes from user address addr to inode ip at *off,
+// advancing *off, in as few log transactions as will do.
+static int
+inodewrite(struct inode *ip, uint64 addr, int n, uint *off)
+{
+  int r;
+
+  // write as many blocks at a time as the log will take,
+  // reserving room for each data block plus the allocation
+  // bitmap block it may dirty, the i-node, the indirect
+  // block, and a block of slop for a non-aligned start.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+
+  // 我们不能保证write系统调用是原子性的尽管MIT6.S081课上说是
+  // https://mit-public-courses-cn-translatio.gitbook.io/mit6-s081/lec15-crash-recovery-frans/15.3-file-system-logging
+  // 这里如果对一个文件的写内容大于一定程度会分多次写
+  // begin_op和end_op标志着一个事务的开始与结束
+
+  // a page of addr mapped from ip itself would have to lock
+  // ip to fault in under writei(); do that beforehand.
+  vmprefault(myproc(), addr, n);
+
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    int nb = begin_opn(2*(n1/BSIZE + 2) + 2);
+    int max = ((nb-1-1-2) / 2) * BSIZE;
+    if(n1 > max)
+      n1 = max;
+
+    ilock(ip);
+    if ((r = writei(ip, 1, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(ip);
+    end_opn(nb);
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
-  // if (intr_get()) {
-  //   printf("Intr_on\n");
-  // } else {
-  //   printf("Intr_off\n");
-  // }
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, 0);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
+    vmprefault(myproc(), addr, n);
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-
-    // 我们不能保证write系统调用是原子性的尽管MIT6.S081课上说是
-    // https://mit-public-courses-cn-translatio.gitbook.io/mit6-s081/lec15-crash-recovery-frans/15.3-file-system-logging
-    // 这里如果对一个文件的写内容大于一定程度会分多次写
-    // begin_op和end_op标志着一个事务的开始与结束
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      printf("%d ", log.outstanding);
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-
-    }
-    ret = (i == n ? n : -1);
+    ret = inodewrite(f->ip, addr, n, &f->off);
   } else {
     panic("filewrite");
   }
@@ -210,3 +214,28 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read from file f at offset off, leaving f->off alone.
+// Only files and directories have offsets.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  vmprefault(myproc(), addr, n);
+  ilockshared(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlockshared(f->ip);
+  return r;
+}
+
+// Write to file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f->ip, addr, n, &off);
+}
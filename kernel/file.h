@@ -1,12 +1,14 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SEM } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct sleeplock offlock; // serializes reads that move off
   short major;       // FD_DEVICE
+  struct sem *sem;   // FD_SEM
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -18,6 +20,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // C pointer reference count (一个inode的ref如果大于0，则会使系统将该inode保留在icache缓存中，而不会重用该inode)
+  struct inode *hnext; // hash chain, protected by icache.lock
+  struct inode *prev;  // LRU list of unreferenced inodes
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +32,10 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  struct dirhash *dh;  // T_DIR lookup index, or 0 (see fs.c)
+  int dhwait;          // lookups to go before trying to build one again
+  int ntext;           // pages in the shared text cache (see mmap.c)
 };
 
 // map major device number to device functions.
@@ -15,6 +15,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -37,6 +38,8 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void bsuminit(int dev);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,47 +47,176 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
+// The old contents are not needed, so it is not read from disk;
+// bnew() zeroes it in the cache.
 static void
 bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
+  bp = bnew(dev, bno);
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// To avoid rescanning the bitmap from block 0 on every allocation,
+// the kernel keeps an in-memory summary of each bitmap block: how
+// many of its bits are free, and a bit below which none are free.
+// The summary is built from the disk at fsinit() and kept up to date
+// by ballocn() and bfree(), which change it while holding the bitmap
+// block's buffer lock. Allocation starts at a goal block, normally
+// just past the previous block of the same file, so that files end
+// up laid out contiguously; with no goal it continues from where the
+// last allocation left off.
+
+#define NBITMAP (FSSIZE/BPB + 1)  // max bitmap blocks
+#define MAXRUN  16                // max blocks per ballocn()
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+struct {
+  struct spinlock lock;
+  int nbitmap;           // number of bitmap blocks in use
+  uint nfree[NBITMAP];   // free bits in each bitmap block
+  uint first[NBITMAP];   // no free bits below this one
+  uint cursor;           // just past the last allocated block
+} bsum;
+
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
+  int i, bi;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+  initlock(&bsum.lock, "bsum");
+  bsum.nbitmap = (sb.size + BPB - 1) / BPB;
+  if(bsum.nbitmap > NBITMAP)
+    panic("bsuminit: bitmap too big");
+  for(i = 0; i < bsum.nbitmap; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    bsum.nfree[i] = 0;
+    bsum.first[i] = BPB;
+    for(bi = 0; bi < BPB && i*BPB + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+        if(bsum.nfree[i]++ == 0)
+          bsum.first[i] = bi;
       }
     }
     brelse(bp);
   }
+  bsum.cursor = 0;
+}
+
+// Find the first free bit at or after bit from in the bitmap
+// block bp, which covers blocks base..base+BPB-1.
+// Returns -1 if there is none.
+static int
+bfind(struct buf *bp, uint base, int from)
+{
+  int bi;
+
+  for(bi = from; bi < BPB && base + bi < sb.size; bi++){
+    if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+      bi += 7;  // skip a full byte
+      continue;
+    }
+    if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+      return bi;
+  }
+  return -1;
+}
+
+// Allocate up to n disk blocks, preferring blocks just past
+// near (or past the last allocation if near is 0), and return how
+// many were allocated. The blocks are consecutive on disk and their
+// numbers are stored in bnos[]. Takes a single bitmap block through
+// the log, however many blocks are allocated.
+//
+// The blocks are not zeroed: data blocks are always allocated past
+// the end of the file, so writei() fills them in the cache with
+// bnew() rather than logging a zeroed copy first. Callers that need
+// zeroed blocks (indirect blocks) must bzero() them.
+static int
+ballocn(uint dev, uint near, uint *bnos, int n)
+{
+  int i, k, bi, from, got;
+  uint goal, base;
+  struct buf *bp;
+
+  if(n > MAXRUN)
+    n = MAXRUN;
+  goal = near ? near + 1 : bsum.cursor;
+  if(goal >= sb.size)
+    goal = 0;
+
+  // Visit the bitmap blocks starting with the goal's, wrapping
+  // around, and finally the goal's block again below the goal.
+  for(k = 0; k <= bsum.nbitmap; k++){
+    i = (goal/BPB + k) % bsum.nbitmap;
+    acquire(&bsum.lock);
+    if(bsum.nfree[i] == 0){
+      release(&bsum.lock);
+      continue;
+    }
+    from = bsum.first[i];
+    if(k == 0 && goal % BPB > from)
+      from = goal % BPB;
+    release(&bsum.lock);
+
+    base = i * BPB;
+    bp = bread(dev, sb.bmapstart + i);
+    if((bi = bfind(bp, base, from)) < 0){
+      brelse(bp);
+      continue;
+    }
+    // Take a run of free blocks starting at bi.
+    for(got = 0; got < n && bi + got < BPB && base + bi + got < sb.size; got++){
+      int m = 1 << ((bi + got) % 8);
+      if(bp->data[(bi + got)/8] & m)
+        break;
+      bp->data[(bi + got)/8] |= m;  // Mark block in use.
+      bnos[got] = base + bi + got;
+    }
+    log_write(bp);
+
+    acquire(&bsum.lock);
+    bsum.nfree[i] -= got;
+    if(bi == bsum.first[i])
+      bsum.first[i] = bi + got;
+    bsum.cursor = base + bi + got;
+    release(&bsum.lock);
+    brelse(bp);
+    return got;
+  }
   panic("balloc: out of blocks");
 }
 
+// Allocate a disk block, near block near if possible.
+// The block's contents are garbage; see ballocn().
+static uint
+balloc(uint dev, uint near)
+{
+  uint b;
+
+  ballocn(dev, near, &b, 1);
+  return b;
+}
+
+// Allocate a zeroed disk block, for use as an indirect block.
+static uint
+balloczero(uint dev, uint near)
+{
+  uint b;
+
+  b = balloc(dev, near);
+  bzero(dev, b);
+  return b;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -99,6 +231,12 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+
+  acquire(&bsum.lock);
+  bsum.nfree[b/BPB]++;
+  if(bi < bsum.first[b/BPB])
+    bsum.first[b/BPB] = bi;
+  release(&bsum.lock);
   brelse(bp);
 }
 
@@ -170,25 +308,74 @@ bfree(int dev, uint b)
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// Cached inodes are found through a hash table on (dev, inum).
+// An inode whose ref drops to zero stays in the table, still
+// valid, and goes on an LRU list; iget() reuses it if the same
+// i-node is wanted again and otherwise recycles the least recently
+// used one. Inodes come from a slab cache as they are first needed,
+// up to 1/IMEMFRAC of the memory that is free at boot but never
+// fewer than NINODE; past that, iget() recycles, and only makes a
+// new one if every cached inode is in use. Those extra inodes go
+// back to the slab cache when their last reference is dropped.
+
+#define IMEMFRAC  256
+#define NIHASH    (PGSIZE/sizeof(struct inode*))
+#define IHASH(dev, inum)  (((dev) * 31 + (inum)) % NIHASH)
 
 // 主要工作其实是同步多个进程的访问，缓存是次要的
 struct {
   struct spinlock lock;  // icache.lock保证了一个inode在缓存只有一个副本，以及缓存inode的ref字段计数正确
-  struct inode inode[NINODE];
+  int ninode;            // inodes allocated
+  int max;               // inodes to keep
+  struct slabcache cache;
+  struct inode **hash;   // NIHASH chains linked by hnext
+
+  // LRU list of inodes with ref == 0.
+  // head.next is most recent, head.prev is least.
+  struct inode head;
 } icache;
 
+static void dcinit(void);
+static void dhdetach(struct inode*);
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+  slabinit(&icache.cache, "inodecache", sizeof(struct inode));
+  if((icache.hash = (struct inode**)kalloc()) == 0)
+    panic("iinit");
+  memset(icache.hash, 0, PGSIZE);
+  icache.head.prev = &icache.head;
+  icache.head.next = &icache.head;
+
+  icache.max = kfreemem() / IMEMFRAC / sizeof(struct inode);
+  if(icache.max < NINODE)
+    icache.max = NINODE;
+  dcinit();
+}
+
+// Take ip out of the hash table and detach what refers to it
+// by pointer. Caller must hold icache.lock, and ip->ref == 0.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  if(ip->inum != 0){
+    for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
   }
+  dhdetach(ip);
+  textinval(ip);
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void dirhashfree(struct inode*);
+static void dcenter(uint, uint, char*, uint);
+static void dcpurge(uint, uint);
 
 // 创建一个新文件时分配inode
 // 由于一次只能有一个进程持有对bp的引用，ialloc可以确保其他进程不会同时看到inode是可用的并使用它
@@ -246,31 +433,47 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = icache.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0){
+        ip->next->prev = ip->prev;
+        ip->prev->next = ip->next;
+      }
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  // Make a new inode while under the limit, or when none is
+  // free; otherwise recycle the least recently used.
+  ip = 0;
+  if(icache.ninode < icache.max || icache.head.prev == &icache.head){
+    if((ip = slaballoc(&icache.cache)) != 0){
+      memset(ip, 0, sizeof(*ip));
+      initsleeplock(&ip->lock, "inode");
+      icache.ninode++;
+    }
+  }
+  if(ip == 0){
+    ip = icache.head.prev;
+    if(ip == &icache.head)
+      panic("iget: no inodes");
+    ip->next->prev = ip->prev;
+    ip->prev->next = ip->next;
+    iunhash(ip);
+  }
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->dhwait = 0;
+  ip->hnext = icache.hash[IHASH(dev, inum)];
+  icache.hash[IHASH(dev, inum)] = ip;
   release(&icache.lock);
 
   return ip;
@@ -327,6 +530,34 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock ip for reading only, so that other readers can go on at
+// the same time: enough for readi() and stati(), but not for
+// anything that changes ip or a directory's index. Reads the
+// inode from disk if necessary, under the exclusive lock.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -348,6 +579,8 @@ iput(struct inode *ip)
 
     release(&icache.lock);
 
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -359,6 +592,23 @@ iput(struct inode *ip)
   }
 
   ip->ref--;
+  if(ip->ref == 0 && icache.ninode > icache.max){
+    // one made when the cache was full: free it.
+    iunhash(ip);
+    icache.ninode--;
+    slabfree(&icache.cache, ip);
+  } else if(ip->ref == 0){
+    // Keep it cached; one that is no longer valid goes first.
+    if(ip->valid){
+      ip->next = icache.head.next;
+      ip->prev = &icache.head;
+    } else {
+      ip->next = &icache.head;
+      ip->prev = icache.head.prev;
+    }
+    ip->next->prev = ip;
+    ip->prev->next = ip;
+  }
   release(&icache.lock);
 }
 
@@ -384,7 +634,8 @@ iunlockput(struct inode *ip)
 // 索引中的数据块号
 
 // Return the disk (data) block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, next to the
+// file's previous block if possible.
 static uint
 bmap(struct inode *ip, uint bn)
 {
@@ -393,8 +644,8 @@ bmap(struct inode *ip, uint bn)
 
   // direct block number
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);   // allocate a data block
+    if((addr = ip->addrs[bn]) == 0)   // allocate a data block
+      ip->addrs[bn] = addr = balloc(ip->dev, bn > 0 ? ip->addrs[bn-1] : 0);
     return addr;
   }
   bn -= NDIRECT;
@@ -402,12 +653,13 @@ bmap(struct inode *ip, uint bn)
   // singly-indirect block number
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);    // allocate a indirect block block
+    if((addr = ip->addrs[NDIRECT]) == 0)    // allocate a indirect block block
+      ip->addrs[NDIRECT] = addr = balloczero(ip->dev, ip->addrs[NDIRECT-1]);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);   // allocate a data block
+      // allocate a data block
+      a[bn] = addr = balloc(ip->dev, bn > 0 ? a[bn-1] : ip->addrs[NDIRECT-1]);
       log_write(bp);
     }
     brelse(bp);
@@ -417,6 +669,69 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Fill in the missing entries of a[lo..hi), an array of block
+// addresses (ip->addrs or an indirect block), a run at a time.
+// *prev is the block before a[lo], used as the allocation goal,
+// and is updated to the last block of the array seen.
+// Returns the number of blocks allocated.
+static int
+bmaprun(uint dev, uint *a, uint lo, uint hi, uint *prev)
+{
+  uint i, j, n, got, bnos[MAXRUN];
+
+  got = 0;
+  for(i = lo; i < hi; i++){
+    if(a[i]){
+      *prev = a[i];
+      continue;
+    }
+    for(n = 1; i + n < hi && a[i+n] == 0 && n < MAXRUN; n++)
+      ;
+    n = ballocn(dev, *prev, bnos, n);
+    for(j = 0; j < n; j++)
+      a[i+j] = bnos[j];
+    *prev = bnos[n-1];
+    got += n;
+    i += n - 1;
+  }
+  return got;
+}
+
+// Make sure the nb blocks of ip starting at block bn are allocated,
+// allocating the missing ones several at a time so that a write
+// spanning several blocks takes each bitmap block through the log
+// once and gets contiguous blocks.
+static void
+bmapalloc(struct inode *ip, uint bn, uint nb)
+{
+  uint end, lo, prev;
+  struct buf *bp;
+  uint *a;
+
+  end = min(bn + nb, MAXFILE);
+  prev = 0;
+  if(bn < NDIRECT){
+    if(bn > 0)
+      prev = ip->addrs[bn-1];
+    bmaprun(ip->dev, ip->addrs, bn, min(end, NDIRECT), &prev);
+  } else {
+    prev = ip->addrs[NDIRECT-1];
+  }
+
+  if(end > NDIRECT){
+    if(ip->addrs[NDIRECT] == 0)
+      ip->addrs[NDIRECT] = balloczero(ip->dev, prev);
+    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    a = (uint*)bp->data;
+    lo = (bn > NDIRECT ? bn : NDIRECT) - NDIRECT;
+    if(lo > 0 && a[lo-1])
+      prev = a[lo-1];
+    if(bmaprun(ip->dev, a, lo, end - NDIRECT, &prev) > 0)
+      log_write(bp);
+    brelse(bp);
+  }
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -426,6 +741,9 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  dirhashfree(ip);
+  textinval(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -450,7 +768,7 @@ itrunc(struct inode *ip)
 }
 
 // Copy stat information from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or not.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -462,7 +780,9 @@ stati(struct inode *ip, struct stat *st)
 }
 
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or not: every block below
+// ip->size is allocated (writei() never leaves a hole), so the
+// bmap() calls here change nothing.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -504,8 +824,19 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  textinval(ip);
+  if(n > 0)
+    bmapalloc(ip, off/BSIZE, (off + n - 1)/BSIZE - off/BSIZE + 1);
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    // A block that lies wholly past the end of the file holds
+    // nothing worth reading (writes never leave a hole, and data
+    // blocks are allocated unzeroed), so start from zeroes in the
+    // cache and log only the data written into it.
+    if(off - off%BSIZE >= ip->size)
+      bp = bnew(ip->dev, bmap(ip, off/BSIZE));
+    else
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
@@ -529,6 +860,44 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 }
 
 // Directories
+//
+// dirlookup() and dirlink() read a directory a block at a time,
+// not an entry at a time. A directory bigger than one block also
+// gets an in-memory hash index of its entries, built by its first
+// lookup and kept up to date by dirlink() and dirunlink(), so that
+// a lookup reads just the block holding the entry. Each slot of an
+// index holds an entry's position in the directory plus the high
+// bits of its name's hash; deleted entries leave DHDEAD behind.
+//
+// There are NDIRHASH indexes, each with enough pages of slots
+// from kalloc() for about three times as many entries as its
+// directory had when the index was built. A directory keeps its
+// index while its inode stays in the cache; an index whose
+// directory has no references left can be taken over by another.
+// dh->dp and dp->dh are protected by icache.lock, the rest by the
+// directory's lock. A directory that outgrows its index drops it,
+// and its next lookup builds a bigger one. If there is no index
+// or memory to be had, the directory is scanned for the next
+// DHRETRY lookups before trying again.
+
+#define NDIRHASH  8
+#define DHPERPG   (PGSIZE / sizeof(uint))     // slots per page
+#define DHMAXENT  (MAXFILE * BSIZE / sizeof(struct dirent))
+#define DHPAGES   (DHMAXENT * 3 / DHPERPG + 1)
+#define DHRETRY   32
+#define DHDEAD    0xffffffff
+#define DHSLOT(i, h)  (((h) & 0xffff0000) | ((i) + 1))
+#define DHINDEX(s)    (((s) & 0xffff) - 1)
+#define DH(dh, k)     ((dh)->slot[(k) / DHPERPG][(k) % DHPERPG])
+
+struct dirhash {
+  struct inode *dp;     // directory using this index, or 0
+  uint nslot;           // slots in the pages below
+  uint used;            // slots that are not empty (including dead)
+  uint nfree;           // free entries below dp->size
+  uint freeoff;         // no free entry below this offset
+  uint *slot[DHPAGES];  // pages of slots
+} dirhash[NDIRHASH];
 
 int
 namecmp(const char *s, const char *t)
@@ -536,39 +905,248 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+static uint
+namehash(const char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Give directory dp an empty index sized to it, taking one over
+// from an unreferenced directory if need be. Returns 0 if none
+// is free or there is no memory for it.
+static struct dirhash*
+dhalloc(struct inode *dp)
+{
+  struct dirhash *dh;
+  uint i, n;
+
+  acquire(&icache.lock);
+  for(dh = dirhash; dh < &dirhash[NDIRHASH]; dh++)
+    if(dh->dp == 0 || dh->dp->ref == 0)
+      break;
+  if(dh == &dirhash[NDIRHASH]){
+    release(&icache.lock);
+    return 0;
+  }
+  if(dh->dp)
+    dhdetach(dh->dp);
+  dh->dp = dp;
+  dp->dh = dh;
+  release(&icache.lock);
+
+  n = dp->size / sizeof(struct dirent) * 3 / DHPERPG + 1;
+  if(n > DHPAGES)
+    n = DHPAGES;
+  for(i = 0; i < n; i++){
+    if((dh->slot[i] = kalloc()) == 0){
+      dirhashfree(dp);
+      return 0;
+    }
+    memset(dh->slot[i], 0, PGSIZE);
+  }
+  dh->nslot = n * DHPERPG;
+  dh->used = 0;
+  dh->nfree = 0;
+  dh->freeoff = dp->size;
+  return dh;
+}
+
+// Drop dp's lookup index, if it has one, and free its pages.
+// Caller must hold icache.lock.
+static void
+dhdetach(struct inode *dp)
+{
+  struct dirhash *dh;
+  int i;
+
+  if((dh = dp->dh) == 0)
+    return;
+  for(i = 0; i < DHPAGES && dh->slot[i]; i++){
+    kfree(dh->slot[i]);
+    dh->slot[i] = 0;
+  }
+  dh->nslot = 0;
+  dh->dp = 0;
+  dp->dh = 0;
+}
+
+static void
+dirhashfree(struct inode *dp)
+{
+  acquire(&icache.lock);
+  dhdetach(dp);
+  release(&icache.lock);
+}
+
+// Add the entry for name at index i to the lookup index.
+// Returns -1 if the index is full.
+static int
+dhinsert(struct dirhash *dh, const char *name, uint i)
+{
+  uint h, k;
+
+  if(dh->used >= dh->nslot*3/4)
+    return -1;
+  h = namehash(name);
+  for(k = h % dh->nslot; ; k = (k + 1) % dh->nslot){
+    if(DH(dh, k) == 0 || DH(dh, k) == DHDEAD){
+      if(DH(dh, k) == 0)
+        dh->used++;
+      DH(dh, k) = DHSLOT(i, h);
+      return 0;
+    }
+  }
+}
+
+// Remove the entry for name at index i from the lookup index.
+static void
+dhremove(struct dirhash *dh, const char *name, uint i)
+{
+  uint h, k;
+
+  h = namehash(name);
+  for(k = h % dh->nslot; DH(dh, k) != 0; k = (k + 1) % dh->nslot){
+    if(DH(dh, k) == DHSLOT(i, h)){
+      DH(dh, k) = DHDEAD;
+      return;
+    }
+  }
+}
+
+// Build the lookup index for dp with one scan of its blocks.
+// Leaves dp without an index, and not to be tried again for a
+// while, if none can be had.
+static void
+dirhashbuild(struct inode *dp)
+{
+  struct dirhash *dh;
+  struct dirent *de;
+  struct buf *bp;
+  uint off, end;
+
+  if((dh = dhalloc(dp)) == 0){
+    dp->dhwait = DHRETRY;
+    return;
+  }
+  for(off = 0; off < dp->size; off = end){
+    bp = bread(dp->dev, bmap(dp, off/BSIZE));
+    end = min(dp->size, off - off%BSIZE + BSIZE);
+    for(; off < end; off += sizeof(*de)){
+      de = (struct dirent*)(bp->data + off%BSIZE);
+      if(de->inum == 0){
+        if(dh->nfree++ == 0)
+          dh->freeoff = off;
+      } else if(dhinsert(dh, de->name, off/sizeof(*de)) < 0){
+        brelse(bp);
+        dirhashfree(dp);
+        dp->dhwait = DHRETRY;
+        return;
+      }
+    }
+    brelse(bp);
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint off, end, h, k;
+  struct dirent *de, de1;
+  struct dirhash *dh;
+  struct buf *bp;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+  if(dp->dh == 0 && dp->size > BSIZE){
+    if(dp->dhwait > 0)
+      dp->dhwait--;
+    else
+      dirhashbuild(dp);
+  }
+
+  if((dh = dp->dh) != 0){
+    h = namehash(name);
+    for(k = h % dh->nslot; DH(dh, k) != 0; k = (k + 1) % dh->nslot){
+      if(DH(dh, k) == DHDEAD || (DH(dh, k) & 0xffff0000) != (h & 0xffff0000))
+        continue;
+      off = DHINDEX(DH(dh, k)) * sizeof(de1);
+      if(readi(dp, 0, (uint64)&de1, off, sizeof(de1)) != sizeof(de1))
+        panic("dirlookup read");
+      if(de1.inum != 0 && namecmp(name, de1.name) == 0){
+        if(poff)
+          *poff = off;
+        return iget(dp->dev, de1.inum);
+      }
+    }
+    return 0;
+  }
+
+  for(off = 0; off < dp->size; off = end){
+    bp = bread(dp->dev, bmap(dp, off/BSIZE));
+    end = min(dp->size, off - off%BSIZE + BSIZE);
+    for(; off < end; off += sizeof(*de)){
+      de = (struct dirent*)(bp->data + off%BSIZE);
+      if(de->inum == 0)
+        continue;
+      if(namecmp(name, de->name) == 0){
+        // entry matches path element
+        if(poff)
+          *poff = off;
+        k = de->inum;
+        brelse(bp);
+        return iget(dp->dev, k);
+      }
     }
+    brelse(bp);
   }
 
   return 0;
 }
 
+// Return the offset of a free entry in dp, or dp->size if
+// there is none.
+static uint
+dirfree(struct inode *dp)
+{
+  uint off, end;
+  struct dirent *de;
+  struct buf *bp;
+
+  off = 0;
+  if(dp->dh){
+    if(dp->dh->nfree == 0)
+      return dp->size;
+    off = dp->dh->freeoff;
+  }
+  for(; off < dp->size; off = end){
+    bp = bread(dp->dev, bmap(dp, off/BSIZE));
+    end = min(dp->size, off - off%BSIZE + BSIZE);
+    for(; off < end; off += sizeof(*de)){
+      de = (struct dirent*)(bp->data + off%BSIZE);
+      if(de->inum == 0){
+        brelse(bp);
+        return off;
+      }
+    }
+    brelse(bp);
+  }
+  return dp->size;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  uint off;
   struct dirent de;
   struct inode *ip;
 
@@ -579,21 +1157,163 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
-  }
+  off = dirfree(dp);
 
+  memset(&de, 0, sizeof(de));
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
+  if(dp->dh && off < dp->size){
+    dp->dh->nfree--;
+    dp->dh->freeoff = off + sizeof(de);
+  }
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  if(dp->dh && dhinsert(dp->dh, de.name, off/sizeof(de)) < 0)
+    dirhashfree(dp);
+  dcenter(dp->dev, dp->inum, de.name, inum);
 
   return 0;
 }
 
+// Remove the directory entry at offset off from dp.
+void
+dirunlink(struct inode *dp, uint off)
+{
+  struct dirent de;
+
+  if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink read");
+  if(dp->dh){
+    dhremove(dp->dh, de.name, off/sizeof(de));
+    dp->dh->nfree++;
+    if(off < dp->dh->freeoff)
+      dp->dh->freeoff = off;
+  }
+  dcenter(dp->dev, dp->inum, de.name, 0);
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+}
+
+// Name cache.
+//
+// namex() looks each path element up in a cache of earlier
+// dirlookup() results before locking and scanning the directory.
+// An entry maps (dev, directory inum, name) to the inum the name
+// refers to, or to 0 if the directory has no such name. dirlink()
+// and dirunlink() update the entries for the names they change and
+// freeing a directory purges its entries, so the cache always gives
+// the answer dirlookup() would. The cache is a set-associative
+// table with round-robin replacement within a set; dcache.lock
+// protects it and the statistics, and is taken before icache.lock.
+
+#define NDCSET  64   // sets in the name cache
+#define NDCWAY  4    // entries per set
+
+struct dcentry {
+  uint dev;          // 0 if the entry is unused
+  uint dir;          // inum of the directory
+  uint inum;         // inum of the name, or 0 if absent
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry set[NDCSET][NDCWAY];
+  uchar next[NDCSET];     // entry to replace next in each set
+  struct dcachestat st;
+} dcache;
+
+static void
+dcinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dcentry*
+dcfind(uint dev, uint dir, char *name, struct dcentry **set)
+{
+  struct dcentry *e;
+
+  *set = dcache.set[(namehash(name) ^ dir ^ (dev << 8)) % NDCSET];
+  for(e = *set; e < *set + NDCWAY; e++)
+    if(e->dev == dev && e->dir == dir && namecmp(e->name, name) == 0)
+      return e;
+  return 0;
+}
+
+// Look name up in directory dp in the name cache.
+// On a hit, set *hit and return the referenced inode, or 0 if
+// the name is known to be absent. The iget() happens under
+// dcache.lock, so the inode cannot be freed by a concurrent
+// unlink before we hold our reference.
+static struct inode*
+dcget(struct inode *dp, char *name, int *hit)
+{
+  struct dcentry *e, *set;
+  struct inode *ip;
+
+  ip = 0;
+  acquire(&dcache.lock);
+  if((e = dcfind(dp->dev, dp->inum, name, &set)) != 0){
+    *hit = 1;
+    dcache.st.hits++;
+    if(e->inum)
+      ip = iget(e->dev, e->inum);
+    else
+      dcache.st.neghits++;
+  } else {
+    *hit = 0;
+    dcache.st.misses++;
+  }
+  release(&dcache.lock);
+  return ip;
+}
+
+// Record that name in directory dir refers to inum
+// (or, if inum is 0, that there is no such name).
+static void
+dcenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dcentry *e, *set;
+  int s;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dev, dir, name, &set)) == 0){
+    s = set - dcache.set[0];
+    s /= NDCWAY;
+    e = &set[dcache.next[s]];
+    dcache.next[s] = (dcache.next[s] + 1) % NDCWAY;
+    e->dev = dev;
+    e->dir = dir;
+    strncpy(e->name, name, DIRSIZ);
+  }
+  e->inum = inum;
+  release(&dcache.lock);
+}
+
+// Forget all names in directory dir, which is being freed.
+static void
+dcpurge(uint dev, uint dir)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  for(e = dcache.set[0]; e < dcache.set[0] + NDCSET*NDCWAY; e++)
+    if(e->dev == dev && e->dir == dir)
+      e->dev = 0;
+  release(&dcache.lock);
+}
+
+// Copy out the name cache statistics.
+void
+dcstat(struct dcachestat *st)
+{
+  acquire(&dcache.lock);
+  *st = dcache.st;
+  release(&dcache.lock);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -641,13 +1361,26 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  int hit;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = idup(myproc()->files->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    if(!nameiparent || *path != '\0'){
+      // Only directories have names cached under them, so a
+      // hit needs neither ilock() nor a type check.
+      next = dcget(ip, name, &hit);
+      if(hit){
+        iput(ip);
+        if(next == 0)
+          return 0;
+        ip = next;
+        continue;
+      }
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -658,7 +1391,9 @@ namex(char *path, int nameiparent, char *name)
       iunlock(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
+    next = dirlookup(ip, name, 0);
+    dcenter(ip->dev, ip->inum, name, next ? next->inum : 0);
+    if(next == 0){
       iunlockput(ip);
       return 0;
     }
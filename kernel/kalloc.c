@@ -18,9 +18,15 @@ struct run {
   struct run *next;
 };
 
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+// A page is free once its last reference is dropped; pages
+// start with one reference from kalloc(), and kref() adds more
+// for pages that are mapped more than once.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int ref[(PHYSTOP - KERNBASE) / PGSIZE];
 } kmem;
 
 void
@@ -35,14 +41,16 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kmem.ref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed at
+// by pa, freeing it if that was the last one. pa normally
+// should have been returned by a call to kalloc().  (The
+// exception is when initializing the allocator; see kinit above.)
 void
 kfree(void *pa)     // 参数是某个页的起始 内核虚拟地址(直接映射物理页地址)
 {
@@ -52,6 +60,15 @@ kfree(void *pa)     // 参数是某个页的起始 内核虚拟地址(直接映
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kfree: ref");
+  if(--kmem.ref[PA2REF(pa)] > 0){
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -73,11 +90,60 @@ kalloc(void)
 
   acquire(&kmem.lock);      // 加锁
   r = kmem.freelist;        // 从空闲物理页链表头部拿一个节点(页)出来
-  if(r)
+  if(r == 0){
+    // out of pages: give back cached program text
+    // that no process has mapped, and try again.
+    release(&kmem.lock);
+    if(textreclaim() == 0)
+      return 0;
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+  }
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[PA2REF(r)] = 1;
+  }
   release(&kmem.lock);      // 解锁
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;          // 返回这个页的 "起始内核虚拟地址(等于物理地址)"
 }
+
+// Return the number of bytes of free memory.
+uint64
+kfreemem(void)
+{
+  struct run *r;
+  uint64 n;
+
+  n = 0;
+  acquire(&kmem.lock);
+  for(r = kmem.freelist; r; r = r->next)
+    n += PGSIZE;
+  release(&kmem.lock);
+  return n;
+}
+
+// Add a reference to page pa, which kfree() will drop.
+void
+kref(void *pa)
+{
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] < 1)
+    panic("kref");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[PA2REF(pa)];
+  release(&kmem.lock);
+  return n;
+}
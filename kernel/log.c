@@ -47,6 +47,7 @@ struct log {
   int start;       // logstart
   int size;        // Number of log blocks (struct superlog.nlog)
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by executing calls
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
@@ -138,31 +139,56 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Like begin_op(), but reserve room for n blocks in the log
+// rather than MAXOPBLOCKS, for a call such as a big write that
+// knows how much it may write. n is cut down to what one
+// transaction can hold; returns the number of blocks reserved,
+// which the caller must pass to end_opn().
+int
+begin_opn(int n)
+{
+  if(n > LOGSIZE)
+    n = LOGSIZE;
+  if(n > log.size - 1)
+    n = log.size - 1;
+
   acquire(&log.lock);
   while(1){
     if(log.committing){     // 等待正在被commit中进行睡眠
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){  // 没有足够的日志空间用来容纳日志时会等待有充足空间再进行
-      // 假设每次系统调用最多写入MAXOPBLOCKS个块
+    } else if(log.lh.n + log.reserved + n > LOGSIZE){  // 没有足够的日志空间用来容纳日志时会等待有充足空间再进行
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {  // 可以将多个系统调用的写操作封装在一个事务中
       log.outstanding += 1; // 在本次commit中，多一个事务(内核线程)，并且该事务占有该commit中，别开始commit提交
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
+  return n;
 }
 
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
 end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// End an operation started with begin_opn(), which reserved n blocks.
+void
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -170,7 +196,7 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing log.reserved has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
@@ -27,6 +27,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    textinit();      // shared program text cache
+    seminit();       // named semaphores
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process [P.S. 只有CPU hartid为0的hart执行userinit]
     __sync_synchronize();
@@ -64,6 +64,10 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   RING (p->mm->ring, if the process called ringsetup())
+//   THREADFRAME(1..NTHREAD-1) (trapframes of threads made by clone())
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define THREADFRAME(t) (TRAPFRAME - (t)*PGSIZE)
+#define RING (THREADFRAME(NTHREAD))
@@ -0,0 +1,589 @@
+//
+// Memory-mapped files, demand-paged programs, and the user
+// page-fault handler.
+//
+// Each process has NVMA regions that mmap() can map files into,
+// placed top-down from just below RING. A region's pages are
+// filled on first touch from the file through the buffer cache.
+// munmap(), exit() and exec() write pages of a MAP_SHARED region
+// that the process may have changed back to the file.
+//
+// exec() likewise only records the program's segments, and their
+// pages are read from the program file as they are touched.
+// Read-only segment pages (program text) come from a cache keyed
+// by inode and file offset, so every process running a program
+// maps the same physical pages.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+// The shared text cache. Each entry holds a reference to its
+// page. An inode's entries go when the file is written or
+// truncated and when the inode leaves the inode cache, and
+// kalloc() reclaims entries that no process maps any more.
+struct {
+  struct spinlock lock;
+  struct textpg {
+    struct inode *ip;   // 0 if the entry is free
+    uint off;           // file offset of the page
+    uint n;             // bytes read from the file; the rest are zeros
+    char *pa;
+  } pg[NTEXTPG];
+} text;
+
+void
+textinit(void)
+{
+  initlock(&text.lock, "text");
+}
+
+// Drop entry t. Caller must hold text.lock.
+static void
+textdrop(struct textpg *t)
+{
+  t->ip->ntext--;
+  kfree(t->pa);
+  t->ip = 0;
+}
+
+// Return a page holding n bytes of ip from off followed by
+// zeros, with a reference for the caller, shared with any
+// other process running the same program. Returns 0 if
+// memory is short.
+static char*
+textpage(struct inode *ip, uint off, uint n)
+{
+  struct textpg *t, *free;
+  char *mem;
+
+  acquire(&text.lock);
+  for(t = text.pg; t < &text.pg[NTEXTPG]; t++){
+    if(t->ip == ip && t->off == off && t->n == n){
+      kref(t->pa);
+      release(&text.lock);
+      return t->pa;
+    }
+  }
+  release(&text.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  ilockshared(ip);
+  readi(ip, 0, (uint64)mem, off, n);
+
+  // enter the page while ip is still locked, so that
+  // a write to the file can't leave a stale copy behind.
+  acquire(&text.lock);
+  free = 0;
+  for(t = text.pg; t < &text.pg[NTEXTPG]; t++){
+    if(t->ip == ip && t->off == off && t->n == n){
+      // another process read it in meanwhile.
+      kref(t->pa);
+      release(&text.lock);
+      iunlockshared(ip);
+      kfree(mem);
+      return t->pa;
+    }
+    if(free == 0 && (t->ip == 0 || krefcnt(t->pa) == 1))
+      free = t;
+  }
+  if(free){
+    if(free->ip)
+      textdrop(free);
+    free->ip = ip;
+    free->off = off;
+    free->n = n;
+    free->pa = mem;
+    kref(mem);
+    ip->ntext++;
+  }
+  release(&text.lock);
+  iunlockshared(ip);
+  return mem;
+}
+
+// Forget ip's cached pages, because the file is changing or
+// ip is being recycled. Processes that have the pages mapped
+// keep them. Caller must hold ip->lock or icache.lock with
+// ip->ref == 0.
+void
+textinval(struct inode *ip)
+{
+  struct textpg *t;
+
+  if(ip->ntext == 0)
+    return;
+  acquire(&text.lock);
+  for(t = text.pg; t < &text.pg[NTEXTPG]; t++)
+    if(t->ip == ip)
+      textdrop(t);
+  release(&text.lock);
+}
+
+// Free cached pages that no process has mapped, for kalloc().
+// Returns the number of pages freed.
+int
+textreclaim(void)
+{
+  struct textpg *t;
+  int n;
+
+  n = 0;
+  acquire(&text.lock);
+  for(t = text.pg; t < &text.pg[NTEXTPG]; t++){
+    if(t->ip && krefcnt(t->pa) == 1){
+      textdrop(t);
+      n++;
+    }
+  }
+  release(&text.lock);
+  return n;
+}
+
+// Return the region of p that contains va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// The lowest address used by p's mappings, or RING if none;
+// the heap must stay below it.
+uint64
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint64 base;
+
+  base = RING;
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Return the segment of p's program that contains va, or 0.
+// Segment pages above sz were given back by sbrk().
+struct seg*
+seglookup(struct proc *p, uint64 va)
+{
+  struct seg *s;
+
+  if(va >= p->mm->sz)
+    return 0;
+  for(s = p->mm->seg; s < &p->mm->seg[NSEG]; s++)
+    if(s->len && va >= s->addr && va < s->addr + s->len)
+      return s;
+  return 0;
+}
+
+// sbrk() has shrunk p's memory; cut the segments back to the
+// new size, so that if the heap grows over them again, the
+// memory there reads back as zeros like any new heap page.
+// Caller must hold p->mm->lock.
+void
+segtrim(struct proc *p)
+{
+  uint64 sz = p->mm->sz;
+  struct seg *s;
+
+  for(s = p->mm->seg; s < &p->mm->seg[NSEG]; s++){
+    if(s->len == 0 || s->addr + s->len <= sz)
+      continue;
+    s->len = s->addr < sz ? sz - s->addr : 0;
+    if(s->filesz > s->len)
+      s->filesz = s->len;
+  }
+  if(p->mm->heap > sz)
+    p->mm->heap = sz;
+}
+
+// Fill in the page at va, which faulted on a load (write == 0)
+// or a store: from the file for a mapped region or the file part
+// of a program segment, or with zeros for the rest of a segment
+// and the lazily allocated heap. Returns -1 if the process has
+// no business touching va, or memory is short.
+int
+vmfault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  struct seg *s;
+  struct inode *ip;
+  pte_t *pte;
+  char *mem;
+  uint off, n;
+  int perm, locked;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return -1;  // present, so this was a protection fault.
+  // a vfork() child's root page-table page is its own, and
+  // vforkdone() frees only what lies below the parent's slots.
+  if(p->vfork && (p->pagetable[PX(2, va)] & PTE_V) == 0)
+    return -1;
+
+  ip = 0;
+  s = 0;
+  off = n = 0;
+  if((v = vmalookup(p, va)) != 0){
+    if(write && (v->prot & PROT_WRITE) == 0)
+      return -1;
+    ip = v->f->ip;
+    off = v->off + (va - v->addr);
+    n = PGSIZE;
+    perm = PTE_U|PTE_R;
+    if(v->prot & PROT_WRITE)
+      perm |= PTE_W;
+    if(v->prot & PROT_EXEC)
+      perm |= PTE_X;
+  } else if((s = seglookup(p, va)) != 0){
+    if(write && (s->perm & PTE_W) == 0)
+      return -1;
+    if(va - s->addr < s->filesz){
+      ip = p->mm->exe;
+      off = s->off + (va - s->addr);
+      n = s->filesz - (va - s->addr);
+      if(n > PGSIZE)
+        n = PGSIZE;
+    }
+    perm = s->perm;
+  } else {
+    if(va >= p->mm->sz || va < p->mm->heap)
+      return -1;
+    perm = PTE_W|PTE_R|PTE_U;
+  }
+
+  if(ip){
+    // reading the file may sleep, which a caller holding
+    // a spin-lock can't; see vmprefault().
+    push_off();
+    locked = mycpu()->noff > 1;
+    pop_off();
+    if(locked)
+      return -1;
+  }
+  if(s && ip && (perm & PTE_W) == 0){
+    if((mem = textpage(ip, off, n)) == 0)
+      return -1;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(ip){
+      ilockshared(ip);
+      readi(ip, 0, (uint64)mem, off, n);
+      iunlockshared(ip);
+    }
+  }
+
+  // another thread may have filled the page in, or unmapped
+  // va, while we weren't holding the lock.
+  acquire(&p->mm->lock);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    release(&p->mm->lock);
+    kfree(mem);
+    return 0;
+  }
+  if(v ? vmalookup(p, va) != v : s ? seglookup(p, va) != s :
+     va >= p->mm->sz || va < p->mm->heap){
+    release(&p->mm->lock);
+    kfree(mem);
+    return -1;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    release(&p->mm->lock);
+    kfree(mem);
+    return -1;
+  }
+  release(&p->mm->lock);
+  return 0;
+}
+
+// Fault in the pages of [va, va+len) that lie in [lo, hi).
+static void
+prefault(struct proc *p, uint64 va, uint64 len, uint64 lo, uint64 hi)
+{
+  uint64 a, end;
+  pte_t *pte;
+
+  end = va + len;
+  if(end < va)
+    end = MAXVA;
+  if(lo < va)
+    lo = va;
+  if(hi > end)
+    hi = end;
+  for(a = PGROUNDDOWN(lo); a < hi && a < MAXVA; a += PGSIZE)
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      vmfault(p, a, 0);
+}
+
+// Fault in the pages of [va, va+len) that must be read from a
+// file, ahead of a copy that the caller will make holding a
+// spin-lock (copyout() from piperead(), say), since vmfault()
+// can't sleep then. Zero-filled pages fault in fine under a lock.
+void
+vmprefault(struct proc *p, uint64 va, uint64 len)
+{
+  struct vma *v;
+  struct seg *s;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f)
+      prefault(p, va, len, v->addr, v->addr + v->len);
+  for(s = p->mm->seg; s < &p->mm->seg[NSEG]; s++)
+    if(s->len)
+      prefault(p, va, len, s->addr, s->addr + s->filesz);
+}
+
+// Write the pages of [va, va+len) that were written since they
+// were read in back to ip from offset off on, one page per
+// transaction, without growing the file; pages only read may be
+// older than the file. Each page is pinned while it is written,
+// since another thread may unmap it meanwhile.
+static void
+vmawriteback(struct proc *p, struct inode *ip, uint off, uint64 va, uint64 len)
+{
+  uint64 a, pa;
+  pte_t *pte;
+  uint n;
+
+  for(a = va; a < va + len; a += PGSIZE, off += PGSIZE){
+    pa = 0;
+    acquire(&p->mm->lock);
+    if((pte = walk(p->pagetable, a, 0)) != 0 &&
+       (*pte & (PTE_V|PTE_U|PTE_D)) == (PTE_V|PTE_U|PTE_D)){
+      *pte &= ~PTE_D;
+      sfence_vma();
+      pa = PTE2PA(*pte);
+      kref((void*)pa);
+    }
+    release(&p->mm->lock);
+    if(pa == 0)
+      continue;
+    begin_op();
+    ilock(ip);
+    if(off < ip->size){
+      n = ip->size - off;
+      if(n > PGSIZE)
+        n = PGSIZE;
+      writei(ip, 0, pa, off, n);
+    }
+    iunlock(ip);
+    end_op();
+    kfree((void*)pa);
+  }
+}
+
+// Return the region of p that [addr, addr+len) lies in and
+// starts or ends with, or 0. Caller must hold p->mm->lock.
+static struct vma*
+vmaclip(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v;
+
+  if((v = vmalookup(p, addr)) == 0 || addr + len > v->addr + v->len)
+    return 0;
+  if(addr != v->addr && addr + len != v->addr + v->len)
+    return 0;
+  return v;
+}
+
+// Unmap [addr, addr+len), which must lie in one region and
+// start or end where it does.
+int
+munmap(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v;
+  struct file *f;
+  uint off;
+
+  if(addr % PGSIZE || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  acquire(&p->mm->lock);
+  if((v = vmaclip(p, addr, len)) == 0){
+    release(&p->mm->lock);
+    return -1;
+  }
+  if((v->flags & MAP_SHARED) && (v->prot & PROT_WRITE)){
+    // writing back sleeps, so not under the lock; hold on to
+    // the file in case another thread unmaps the region.
+    f = filedup(v->f);
+    off = v->off + (addr - v->addr);
+    release(&p->mm->lock);
+    vmawriteback(p, f->ip, off, addr, len);
+    fileclose(f);
+    acquire(&p->mm->lock);
+    if((v = vmaclip(p, addr, len)) == 0){
+      release(&p->mm->lock);
+      return -1;
+    }
+  }
+  uvmunmap(p->pagetable, addr, len/PGSIZE, 1);
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  f = 0;
+  if(v->len == 0){
+    f = v->f;
+    v->f = 0;
+  }
+  release(&p->mm->lock);
+  if(f)
+    fileclose(f);
+  return 0;
+}
+
+// Unmap all of p's regions, as at exit() and exec().
+void
+vmafree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f)
+      munmap(p, v->addr, v->len);
+}
+
+// Give child np copies of p's regions and of their present pages.
+int
+vmacopy(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++){
+    if(v->f == 0)
+      continue;
+    if(uvmcopyrange(p->pagetable, np->pagetable, v->addr, v->addr + v->len) < 0){
+      vmafree(np);
+      return -1;
+    }
+    np->mm->vma[v - p->mm->vma] = *v;
+    filedup(v->f);
+  }
+  return 0;
+}
+
+// void *mmap(void *addr, int len, int prot, int flags, int fd, int off)
+// addr is ignored; the kernel picks the address.
+uint64
+sys_mmap(void)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  struct file *f;
+  uint64 addr;
+  int len, prot, flags, fd, off;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(p->vfork)
+    return -1;  // see vfork()
+  if(len <= 0 || off < 0 || off % PGSIZE)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0)
+    return -1;
+  if((f = fdget(fd)) == 0)
+    return -1;
+  if(f->type != FD_INODE || !f->readable ||
+     ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)){
+    fileclose(f);
+    return -1;
+  }
+
+  acquire(&p->mm->lock);
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f == 0)
+      break;
+  addr = mmapbase(p) - PGROUNDUP(len);
+  if(v == &p->mm->vma[NVMA] || addr < PGROUNDUP(p->mm->sz) || addr >= RING){
+    release(&p->mm->lock);
+    fileclose(f);
+    return -1;
+  }
+
+  v->addr = addr;
+  v->len = PGROUNDUP(len);
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = f;       // takes over fdget()'s reference
+  release(&p->mm->lock);
+  return addr;
+}
+
+// int madvise(void *addr, int len, int advice)
+// MADV_DONTNEED frees the heap pages of [addr, addr+len), which
+// must be page-aligned; they fault back in as zero pages, like
+// heap pages never touched. Not while p has other threads; see
+// sys_munmap().
+uint64
+sys_madvise(void)
+{
+  struct proc *p = myproc();
+  uint64 addr, end;
+  int len, advice;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if(advice != MADV_DONTNEED || addr % PGSIZE || len < 0)
+    return -1;
+  if(p->vfork)
+    return -1;  // the memory belongs to the parent
+  end = addr + PGROUNDUP(len);
+  acquire(&p->mm->lock);
+  if(p->mm->ref > 1 || addr < PGROUNDUP(p->mm->heap) || end > PGROUNDUP(p->mm->sz)){
+    release(&p->mm->lock);
+    return -1;
+  }
+  uvmunmap(p->pagetable, addr, (end - addr) / PGSIZE, 1);
+  release(&p->mm->lock);
+  return 0;
+}
+
+// int munmap(void *addr, int len)
+// Fails while the process has other threads: one running on
+// another CPU could still have the pages in its TLB, and xv6
+// has no way to make that CPU flush it, so freeing them would
+// leave the thread using pages handed out again. A thread's
+// TLB is flushed each time it returns to user space, but it
+// may not trap for a whole timer tick. sbrk() won't shrink
+// the heap then either.
+uint64
+sys_munmap(void)
+{
+  struct proc *p = myproc();
+  uint64 addr;
+  int len, single;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  acquire(&p->mm->lock);
+  single = p->mm->ref == 1;
+  release(&p->mm->lock);
+  if(!single)
+    return -1;
+  return munmap(p, addr, len);
+}
@@ -1,13 +1,19 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NTHREAD       8  // maximum threads per process
+#define NOFILE       16  // open files per process before its table grows
+#define NOFILEMAX   512  // open files per process; a page of pointers
+#define NVMA         16  // memory-mapped regions per process
+#define NSEG          4  // loadable program segments per process
+#define NTEXTPG     512  // size of shared program text cache
+#define NSEM         32  // named semaphores per system
+#define SEMNAME      16  // longest semaphore name, with the NUL
+#define NINODE       50  // minimum number of cached i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes        // 一个op允许写入日志的最大块数
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
@@ -3,24 +3,41 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define PIPEMAXPG 16   // most pages in a pipe's ring
 
-// full buffer: nwrite - nread == PIPESIZE
+// The ring is pi->size bytes kept in separate pages; pi->size is a
+// power-of-two number of pages, so byte i of the stream lives at
+// ring offset i % pi->size even after nread and nwrite wrap.
+// Data moves in chunks that end at a page boundary (which also
+// covers the end of the ring), one copyin() or copyout() each.
+// With splice set (vmsplice()), a chunk that is a whole page on
+// both sides moves by exchanging physical pages instead.
+// full buffer: nwrite - nread == pi->size
 // empty buffer: nwrite - nread == 0
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEMAXPG];
+  uint size;      // ring size in bytes
   uint nread;     // total number of bytes read
   uint nwrite;    // total number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  slabinit(&pipecache, "pipecache", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,8 +47,12 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slaballoc(&pipecache)) == 0)
+    goto bad;
+  memset(pi, 0, sizeof(*pi));
+  if((pi->page[0] = kalloc()) == 0)
     goto bad;
+  pi->size = PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -48,8 +69,11 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
+  if(pi){
+    if(pi->page[0])
+      kfree(pi->page[0]);
+    slabfree(&pipecache, pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -57,6 +81,16 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+static void
+freepages(char **page, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(page[i])
+      kfree(page[i]);
+}
+
 void
 pipeclose(struct pipe *pi, int writable)
 {
@@ -70,23 +104,78 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    freepages(pi->page, pi->size/PGSIZE);
+    slabfree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// Change the ring to hold at least n bytes, rounded up to a
+// power-of-two number of pages, keeping any buffered data.
+// n <= 0 just reports the size. Returns the new size, or -1
+// if n is too big or smaller than the data in the pipe.
+int
+piperesize(struct pipe *pi, int n)
+{
+  char *page[PIPEMAXPG], *old;
+  uint size, i, m;
+
+  if(n <= 0)
+    return pi->size;
+  if(n > PIPEMAXPG*PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size *= 2)
+    ;
+  memset(page, 0, sizeof(page));
+  for(i = 0; i < size/PGSIZE; i++){
+    if((page[i] = kalloc()) == 0){
+      freepages(page, size/PGSIZE);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  if(pi->nwrite - pi->nread > size){
+    release(&pi->lock);
+    freepages(page, size/PGSIZE);
+    return -1;
+  }
+  // both sizes are multiples of PGSIZE, so a chunk that stays
+  // within a page of the old ring stays within one of the new.
+  for(i = pi->nread; i != pi->nwrite; i += m){
+    m = PGSIZE - i%PGSIZE;
+    if(m > pi->nwrite - i)
+      m = pi->nwrite - i;
+    memmove(page[i%size/PGSIZE] + i%PGSIZE,
+            pi->page[i%pi->size/PGSIZE] + i%PGSIZE, m);
+  }
+  n = pi->size/PGSIZE;
+  for(i = 0; i < PIPEMAXPG; i++){
+    old = pi->page[i];
+    pi->page[i] = page[i];
+    page[i] = old;
+  }
+  pi->size = size;
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+
+  freepages(page, n);
+  return size;
+}
 
 // piperead会在buffer为空时在nwrite的channel上睡觉
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int splice)
 {
-  int i;
-  char ch;
+  int i, m;
+  uint off;
+  uint64 pa;
   struct proc *pr = myproc();
 
+  vmprefault(pr, addr, n);
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(pi->nwrite == pi->nread + pi->size){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
@@ -94,9 +183,20 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+    off = pi->nwrite % pi->size;
+    m = PGSIZE - off%PGSIZE;
+    if(m > pi->nread + pi->size - pi->nwrite)
+      m = pi->nread + pi->size - pi->nwrite;
+    if(m > n - i)
+      m = n - i;
+    if(splice && m == PGSIZE && (addr + i) % PGSIZE == 0 &&
+       (pa = uvmtake(pr->pagetable, addr + i)) != 0){
+      // the writer's page becomes part of the ring.
+      kfree(pi->page[off/PGSIZE]);
+      pi->page[off/PGSIZE] = (char*)pa;
+    } else if(copyin(pr->pagetable, pi->page[off/PGSIZE] + off%PGSIZE, addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nwrite += m;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
@@ -105,12 +205,16 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 
 // piperead会在buffer为空时在nread的channel上睡觉
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int splice)
 {
-  int i;
+  int i, m;
+  uint off;
+  uint64 old;
+  char *spare;
   struct proc *pr = myproc();
-  char ch;
 
+  spare = 0;
+  vmprefault(pr, addr, n);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){         // 需要检测是否需要被kill掉，kill函数会标记且唤醒需要被杀死进程，在这里执行具体退出操作
@@ -119,14 +223,30 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)   // full
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    off = pi->nread % pi->size;
+    m = PGSIZE - off%PGSIZE;
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    if(splice && m == PGSIZE && (addr + i) % PGSIZE == 0 &&
+       (spare || (spare = kalloc()) != 0) &&
+       uvmgive(pr->pagetable, addr + i, (uint64)pi->page[off/PGSIZE], &old) == 0){
+      // the ring's page goes to the reader, and the reader's
+      // old page (or a spare, if it had none) takes its place.
+      if(old == 0){
+        old = (uint64)spare;
+        spare = 0;
+      }
+      pi->page[off/PGSIZE] = (char*)old;
+    } else if(copyout(pr->pagetable, addr + i, pi->page[off/PGSIZE] + off%PGSIZE, m) == -1)
       break;
+    pi->nread += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
+  if(spare)
+    kfree(spare);
   return i;
 }
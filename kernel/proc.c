@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "futex.h"
 
 struct cpu cpus[NCPU];      // 全局变量: CPUs的状态信息集合 (CPU Table)
 
@@ -12,12 +13,31 @@ struct proc proc[NPROC];    // 全局变量: 进程Processes的状态信息集
 
 struct proc *initproc;
 
+struct mm mmtab[NPROC];         // memory of each process, shared by its threads
+struct files filestab[NPROC];   // open files of each process, likewise
+
+struct spinlock futex_lock;    // for futex() sleeps and wakeups
+
 int nextpid = 1;            // 分配新进程pid所用
-struct spinlock pid_lock;   // 对pid进行锁保护
+
+// Processes are found by pid through a hash table, so kill()
+// doesn't lock every proc in turn. pid_lock protects the chains
+// and is taken after any p->lock.
+#define NPIDHASH  64
+#define PIDHASH(pid)  ((pid) % NPIDHASH)
+struct proc *pidhash[NPIDHASH];
+struct spinlock pid_lock;
+
+// Each process keeps a list of its children, so wait() and
+// exit() don't scan the process table for them. wait_lock
+// protects every p->parent, p->child and p->sibling, and helps
+// ensure that wakeups of wait()ing parents are not lost. It must
+// be taken before any p->lock.
+struct spinlock wait_lock;
 
 extern void forkret(void);
-static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void threadexit(struct proc *p, int status);
 
 extern char trampoline[]; // trampoline.S
 
@@ -32,6 +52,12 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  initlock(&wait_lock, "wait_lock");
+  initlock(&futex_lock, "futex");
+  for(int i = 0; i < NPROC; i++){
+    initlock(&mmtab[i].lock, "mm");
+    initlock(&filestab[i].lock, "files");
+  }
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -79,22 +105,154 @@ myproc(void) {
 
 int
 allocpid() {
-  int pid;
-  
+  return __sync_fetch_and_add(&nextpid, 1);
+}
+
+// Enter p in the pid hash table, or take it out.
+static void
+pidinsert(struct proc *p)
+{
   acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
+  p->pidnext = pidhash[PIDHASH(p->pid)];
+  pidhash[PIDHASH(p->pid)] = p;
   release(&pid_lock);
+}
 
-  return pid;
+static void
+pidremove(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[PIDHASH(p->pid)]; *pp != p; pp = &(*pp)->pidnext)
+    ;
+  *pp = p->pidnext;
+  release(&pid_lock);
+}
+
+// Return the proc with the given pid, locked, or 0.
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[PIDHASH(pid)]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+  // p may have been freed meanwhile, but proc
+  // structs are never anything else, and pids
+  // are not reused, so checking again will do.
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
+// Make np a child of p.
+static void
+adopt(struct proc *p, struct proc *np)
+{
+  acquire(&wait_lock);
+  np->parent = p;
+  np->sibling = p->child;
+  p->child = np;
+  release(&wait_lock);
+}
+
+// Return an unused mm with one reference, or 0.
+static struct mm*
+mmalloc(void)
+{
+  struct mm *mm;
+
+  for(mm = mmtab; mm < &mmtab[NPROC]; mm++){
+    acquire(&mm->lock);
+    if(mm->ref == 0){
+      mm->ref = 1;
+      mm->tslots = 1;   // THREADFRAME(0) is TRAPFRAME
+      release(&mm->lock);
+      return mm;
+    }
+    release(&mm->lock);
+  }
+  return 0;
+}
+
+// Return an unused files with one reference, or 0.
+static struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+  for(fs = filestab; fs < &filestab[NPROC]; fs++){
+    acquire(&fs->lock);
+    if(fs->ref == 0){
+      fs->ref = 1;
+      fs->ofile = fs->ofile0;
+      fs->nofile = NOFILE;
+      fs->nextfd = 0;
+      release(&fs->lock);
+      return fs;
+    }
+    release(&fs->lock);
+  }
+  return 0;
+}
+
+// Drop p's reference to its open files and current directory,
+// closing them if p was the last thread using them.
+static void
+filesput(struct proc *p)
+{
+  struct files *fs = p->files;
+  int fd;
+
+  p->files = 0;
+  acquire(&fs->lock);
+  if(fs->ref > 1){
+    fs->ref--;
+    release(&fs->lock);
+    return;
+  }
+  release(&fs->lock);
+
+  for(fd = 0; fd < fs->nofile; fd++){
+    if(fs->ofile[fd]){
+      fileclose(fs->ofile[fd]);
+      fs->ofile[fd] = 0;
+    }
+  }
+  if(fs->ofile != fs->ofile0)
+    kfree(fs->ofile);
+  fs->ofile = fs->ofile0;
+  fs->nofile = NOFILE;
+  if(fs->cwd){
+    begin_op();
+    iput(fs->cwd);
+    end_op();
+    fs->cwd = 0;
+  }
+
+  acquire(&fs->lock);
+  fs->ref = 0;
+  release(&fs->lock);
 }
 
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// and return with p->lock held. The caller gives it memory
+// and files: allocproc() new ones, clone() the caller's.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocthread(void)
 {
   struct proc *p;
 
@@ -111,9 +269,37 @@ allocproc(void)
 // 要在found这里填充内核管理进程的PCB信息
 found:
   p->pid = allocpid();
+  p->state = USED;
+  pidinsert(p);
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
+  // Set up new context to start executing at forkret,
+  // which returns to user space.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)forkret;    // 新进程在allocproc时，设置了新进程的context的ra为forkret，那么当某个CPU上发生调度时，scheduler会选择到这个新进程，这个新进程就从这个地方(forkret)开始执行
+  p->context.sp = p->kstack + PGSIZE; // 同上，被再次swtch执行该内核线程时使用的函数调用内核栈在这里被记录恢复时从这里读取加载到sp寄存器
+
+  return p;
+}
+
+// Allocate a proc, as allocthread() does, with its own empty
+// memory and file table.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = allocthread()) == 0)
+    return 0;
+
+  if((p->mm = mmalloc()) == 0 || (p->files = filesalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -128,12 +314,6 @@ found:
     return 0;
   }
 
-  // Set up new context to start executing at forkret,
-  // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
-  p->context.ra = (uint64)forkret;    // 新进程在allocproc时，设置了新进程的context的ra为forkret，那么当某个CPU上发生调度时，scheduler会选择到这个新进程，这个新进程就从这个地方(forkret)开始执行
-  p->context.sp = p->kstack + PGSIZE; // 同上，被再次swtch执行该内核线程时使用的函数调用内核栈在这里被记录恢复时从这里读取加载到sp寄存器
-
   return p;
 }
 
@@ -143,15 +323,45 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  struct mm *mm = p->mm;
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  // a thread gave up its share of the memory and files in
+  // exit(); anyone else still here was the last user.
+  if(mm){
+    if(mm->ring)
+      ringfree(p, p->pagetable);
+    if(p->pagetable)
+      proc_freepagetable(p->pagetable, mm->sz);
+    acquire(&mm->lock);
+    mm->sz = 0;
+    mm->heap = 0;
+    mm->exe = 0;
+    memset(mm->seg, 0, sizeof(mm->seg));
+    mm->tslots = 0;
+    mm->ref = 0;
+    release(&mm->lock);
+  }
+  p->mm = 0;
+  if(p->files){
+    // only a proc that never ran gets here with files.
+    acquire(&p->files->lock);
+    p->files->ref = 0;
+    release(&p->files->lock);
+  }
+  p->files = 0;
   p->pagetable = 0;
-  p->sz = 0;
+  p->thread = 0;
+  p->tslot = 0;
+  p->ctid = 0;
+  if(p->pid)
+    pidremove(p);
   p->pid = 0;
   p->parent = 0;
+  p->child = 0;
+  p->sibling = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
@@ -229,14 +439,15 @@ userinit(void)
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
+  p->mm->heap = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
   p->trapframe->sp = PGSIZE;  // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->files->cwd = namei("/");
 
   p->state = RUNNABLE;
 
@@ -251,7 +462,7 @@ growproc(int n)
   uint sz;
   struct proc *p = myproc();
 
-  sz = p->sz;
+  sz = p->mm->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
       return -1;
@@ -259,7 +470,46 @@ growproc(int n)
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  p->mm->sz = sz;
+  return 0;
+}
+
+// Grow fs's descriptor table from the NOFILE built into it to
+// a page of NOFILEMAX. Returns -1 if it is that big already or
+// there is no memory. Caller must hold fs->lock.
+int
+filesgrow(struct files *fs)
+{
+  struct file **ofile;
+
+  if(fs->ofile != fs->ofile0 || (ofile = kalloc()) == 0)
+    return -1;
+  memset(ofile, 0, PGSIZE);
+  memmove(ofile, fs->ofile0, sizeof(fs->ofile0));
+  fs->ofile = ofile;
+  fs->nofile = NOFILEMAX;
+  return 0;
+}
+
+// Give np copies of p's open files and current directory.
+// Returns -1 if np's table can't grow to hold them.
+static int
+filescopy(struct proc *np, struct proc *p)
+{
+  struct files *fs = p->files;
+  int i;
+
+  acquire(&fs->lock);
+  if(fs->nofile > np->files->nofile && filesgrow(np->files) < 0){
+    release(&fs->lock);
+    return -1;
+  }
+  for(i = 0; i < fs->nofile; i++)
+    if(fs->ofile[i])
+      np->files->ofile[i] = filedup(fs->ofile[i]);
+  np->files->nextfd = fs->nextfd;
+  release(&fs->lock);
+  np->files->cwd = idup(fs->cwd);
   return 0;
 }
 
@@ -268,7 +518,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();    // 获取当前进程PCB
 
@@ -279,14 +529,18 @@ fork(void)
 
   // Copy user memory from parent to child.
   // 拷贝both the page table and the physical memory.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->mm->sz = p->mm->sz;             // 进程虚拟内存大小设置
+  np->mm->heap = p->mm->heap;
+  if(vmacopy(np, p) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;             // 进程虚拟内存大小设置
-
-  np->parent = p;             // 建立父子进程关系
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -295,46 +549,174 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  if(filescopy(np, p) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  if(p->mm->exe)
+    np->mm->exe = idup(p->mm->exe);
+  memmove(np->mm->seg, p->mm->seg, sizeof(p->mm->seg));
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
+  // wait_lock comes before np->lock.
+  release(&np->lock);
+  adopt(p, np);               // 建立父子进程关系
+  acquire(&np->lock);
   np->state = RUNNABLE;   // 等待被调度
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a child that runs in the caller's memory, without
+// copying it, until the child calls exec() or exit(); the
+// caller waits until then. The child gets a root page-table
+// page of its own, pointing at the caller's lower-level pages
+// for all but the top 1GB of the address space. The top holds
+// the child's own trampoline and trapframe, and mmap() regions
+// and the ring, which the child doesn't see. The child can't
+// sbrk(), mmap(), vmsplice() or set up a ring, since that would change
+// the parent's memory or the child's top 1GB, and can't touch
+// parts of the address space the parent had no page-table
+// pages for at vfork() (see vmfault()).
+int
+vfork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  // before np shares any of p's memory, which freeproc() would free.
+  if(filescopy(np, p) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  for(i = 0; i < PX(2, TRAPFRAME); i++)
+    np->pagetable[i] = p->pagetable[i];
+  np->mm->sz = p->mm->sz;
+  np->mm->heap = p->mm->heap;
+  np->vfork = 1;
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->a0 = 0;
+
+  if(p->mm->exe)
+    np->mm->exe = idup(p->mm->exe);
+  memmove(np->mm->seg, p->mm->seg, sizeof(p->mm->seg));
+  safestrcpy(np->name, p->name, sizeof(p->name));
 
+  pid = np->pid;
+  release(&np->lock);
+  adopt(p, np);
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+
+  // the caller's memory is in use until the child is done
+  // with it, so not even kill() may let the caller go on.
+  while(np->vfork)
+    sleep(np, &np->lock);
   release(&np->lock);
 
   return pid;
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold p->lock.
+// vfork() child p is done with its parent's memory, mapped by
+// pagetable, at exec() or exit(). Free p's own page-table pages
+// and let the parent continue.
+void
+vforkdone(struct proc *p, pagetable_t pagetable)
+{
+  int i;
+
+  for(i = 0; i < PX(2, TRAPFRAME); i++)
+    pagetable[i] = 0;
+  proc_freepagetable(pagetable, 0);
+
+  acquire(&p->lock);
+  p->vfork = 0;
+  release(&p->lock);
+  wakeup(p);
+}
+
+// Create a process running the program at path with argv,
+// as fork() followed by exec() in the child would, but without
+// copying the caller's memory only to throw it away. The child
+// takes over the file references in ofile, a table of NOFILEMAX,
+// on success. Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, struct file **ofile)
+{
+  int i, n, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  for(n = NOFILEMAX; n > 0 && ofile[n-1] == 0; n--)
+    ;
+  if((np = allocproc()) == 0)
+    return -1;
+  acquire(&np->files->lock);
+  if(n > np->files->nofile && filesgrow(np->files) < 0){
+    release(&np->files->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  release(&np->files->lock);
+  // loading the program may sleep, so np can't stay locked;
+  // its USED state keeps allocproc() off it meanwhile.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = execproc(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < n; i++){
+    np->files->ofile[i] = ofile[i];
+    ofile[i] = 0;
+  }
+  np->files->cwd = idup(p->files->cwd);
+
+  adopt(p, np);
+  acquire(&np->lock);
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+}
+
+// Pass p's abandoned children to init, and wake init in
+// case any of them has already exited.
+// Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    // this code uses pp->parent without holding pp->lock.
-    // acquiring the lock first could cause a deadlock
-    // if pp or a child of pp were also in exit()
-    // and about to try to lock p.
-    if(pp->parent == p){
-      // pp->parent can't change between the check and the acquire()
-      // because only the parent changes it, and we're the parent.
-      acquire(&pp->lock);
-      pp->parent = initproc;
-      // we should wake up init here, but that would require
-      // initproc->lock, which would be a deadlock, since we hold
-      // the lock on one of init's children (pp). this is why
-      // exit() always wakes init (before acquiring any locks).
-      release(&pp->lock);
-    }
+  if(p->child == 0)
+    return;
+  for(pp = p->child; ; pp = pp->sibling){
+    pp->parent = initproc;
+    if(pp->sibling == 0)
+      break;
   }
+  pp->sibling = initproc->child;
+  initproc->child = p->child;
+  p->child = 0;
+  wakeproc(initproc, initproc);
 }
 
 // sleep和wakeup可以用于许多种需要等待的情况。在xv6book第1章中介绍的一个有趣的例子是，一个子进程的exit和其父进程的wait之间的交互。
@@ -358,66 +740,49 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
+  if(p->thread)
+    threadexit(p, status);
+
+  // the process ends with its last thread.
+  killthreads(p);
+
+  if(p->vfork){
+    vforkdone(p, p->pagetable);
+    p->pagetable = 0;
+    p->mm->sz = 0;
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Write back and unmap mapped files while
+  // they are still open.
+  vmafree(p);
 
-  // we might re-parent a child to init. we can't be precise about
-  // waking up init, since we can't acquire its lock once we've
-  // acquired any other proc lock. so wake up init whether that's
-  // necessary or not. init may miss this wakeup, but that seems
-  // harmless.
-  // 任何一个进程的退出必须有父进程的等待，如果某一个进程有为子进程(即本身为父进程)，那么这个父进程退出时需要把自己所有的子进程reparent
-  // 这里是给要退出的"子进程"的子进程们找新的父进程(init进程)
-  acquire(&initproc->lock);
-  wakeup1(initproc);
-  release(&initproc->lock);
-
-  // grab a copy of p->parent, to ensure that we unlock the same
-  // parent we locked. in case our parent gives us away to init while
-  // we're waiting for the parent lock. we may then race with an
-  // exiting parent, but the result will be a harmless spurious wakeup
-  // to a dead or wrong process; proc structs are never re-allocated
-  // as anything else.
-  // 处理罕见情况：该进程和该进程的父进程可能同时退出
-  // 如果说父子进程同时退出，那么就是在同时执行本函数，关于他俩的PCB数据结构一定会产生race condition
-  // 父进程退出时会调用reparent 子进程p->parent就成了竞争资源
-  // 如果父进程抢先执行reparent改变子进程p->parent为initproc那在子进程后面加锁解锁p->parent->lock那值就不一样
-  // 因此我们要在这里用临时变量记录一下
-  acquire(&p->lock);
-  struct proc *original_parent = p->parent;
-  release(&p->lock);
-  
-  // we need the parent's lock in order to wake it up from wait().
-  // the parent-then-child rule says we have to lock it first.
-  acquire(&original_parent->lock);
+  // Close all open files.
+  filesput(p);
+
+  if(p->mm->exe){
+    begin_op();
+    iput(p->mm->exe);
+    end_op();
+    p->mm->exe = 0;
+  }
 
-  acquire(&p->lock);  // 使得父进程(original_parent)看不见子进程p (父进程执行wait()时acquire(&np->lock)看不到该子进程 会spin等待)
+  acquire(&wait_lock);
 
   // Give any children to init.
+  // 任何一个进程的退出必须有父进程的等待，如果某一个进程有为子进程(即本身为父进程)，那么这个父进程退出时需要把自己所有的子进程reparent
   reparent(p);
 
-  // Parent 'might be' sleeping in wait().
-  // 不能唤醒ZOMBIE态进程
-  // 父进程可能抢先持有自己锁并执行到sched(释放自身锁)调度其他进程运行 那也没事
-  // 子进程被唤醒后如果之前original_parent记录的是原本父进程那也没关系
-  // 执行到这里唤醒原本父进程 原本父进程是ZOMBIE了也无法被唤醒了 跳过这步就好
-  wakeup1(original_parent);
+  // Parent might be sleeping in wait().
+  wakeproc(p->parent, p->parent);
+
+  acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;      // 这个进程很多资源都还没有被清理，因此我们设置一个中间状态ZOMBIE，待到**wait**中再清理占用资源、改变状态并可供重新利用
 
-  release(&original_parent->lock);
+  // the parent can't look at p until it has wait_lock, and
+  // then p->lock, which sched() lets go of.
+  release(&wait_lock);
 
   // 截止到现在 Child也没有free所有的resources，因为其还在执行，父进程此时清除子进程执行所需要的资源在wait中
 
@@ -433,55 +798,184 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
+  struct proc *np, **pp;
+  int pid;
   struct proc *p = myproc();
 
-  // hold p->lock for the whole time to avoid lost
+  // the status is copied out with np->lock held.
+  if(addr != 0)
+    vmprefault(p, addr, sizeof(int));
+
+  // hold wait_lock for the whole time to avoid lost
   // wakeups from a child's exit().
-  acquire(&p->lock);
+  acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      // this code uses np->parent without holding np->lock.
-      // acquiring the lock first would cause a deadlock,
-      // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){    // np值可能等于p，因此不能先对np加锁，否则可能导致死锁。但不用考虑数据安全性吗：一个进程的父进程字段只有“父亲“改变，所以如果np->parent==p为真，除非当前进程改变它，否则该值就不会改变。
-        // np->parent can't change between the check and the acquire()
-        // because only the parent changes it, and we're the parent.
-        acquire(&np->lock);
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
-          freeproc(np);
+    // Look through our children for exited ones.
+    for(pp = &p->child; (np = *pp) != 0; pp = &np->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
-          release(&p->lock);
-          return pid;
+          release(&wait_lock);
+          return -1;
         }
+        *pp = np->sibling;
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
-      release(&p->lock);
+    if(p->child == 0 || p->killed){
+      release(&wait_lock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &p->lock);  //DOC: wait-sleep
+    sleep(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
+// Create a thread that runs fn(arg) on the user stack ending at
+// stack, sharing the caller's memory, open files and current
+// directory. Its trapframe gets a THREADFRAME() slot of its own.
+// The thread id is stored at ctid, if that isn't 0; when the
+// thread exits, the kernel zeroes it and does a futex wake on it,
+// so another thread can wait for the exit and then reuse the
+// stack. Returns the thread id, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack, uint64 ctid)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  int t, tid;
+
+  if(p->vfork)
+    return -1;  // see vfork()
+  if((np = allocthread()) == 0)
+    return -1;
+  // as in spawn(), the USED state keeps np to ourselves.
+  release(&np->lock);
+  tid = np->pid;
+
+  if(ctid != 0 && copyout(p->pagetable, ctid, (char*)&tid, sizeof(tid)) < 0)
+    goto bad;
+
+  acquire(&mm->lock);
+  for(t = 0; t < NTHREAD; t++)
+    if((mm->tslots & (1 << t)) == 0)
+      break;
+  if(t == NTHREAD || mappages(p->pagetable, THREADFRAME(t), PGSIZE,
+                              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&mm->lock);
+    goto bad;
+  }
+  mm->tslots |= 1 << t;
+  mm->ref++;
+  release(&mm->lock);
+  acquire(&p->files->lock);
+  p->files->ref++;
+  release(&p->files->lock);
+
+  np->mm = mm;
+  np->files = p->files;
+  np->pagetable = p->pagetable;
+  np->tslot = t;
+  np->thread = 1;
+  np->ctid = ctid;
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  return tid;
+
+bad:
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
+// Exit thread p, made by clone(). Nothing waits for a thread;
+// once it's off its kernel stack, the scheduler frees it.
+static void
+threadexit(struct proc *p, int status)
+{
+  struct mm *mm = p->mm;
+  int zero = 0;
+
+  if(p->ctid != 0 && copyout(p->pagetable, p->ctid, (char*)&zero, sizeof(zero)) == 0)
+    futex(p->ctid, FUTEX_WAKE, NPROC);
+
+  filesput(p);
+
+  acquire(&mm->lock);
+  uvmunmap(p->pagetable, THREADFRAME(p->tslot), 1, 0);
+  mm->tslots &= ~(1 << p->tslot);
+  mm->ref--;
+  release(&mm->lock);
+  wakeup(mm);   // for killthreads()
+  p->mm = 0;
+  p->pagetable = 0;
+
+  // as in exit(), in case p forked.
+  acquire(&wait_lock);
+  reparent(p);
+  acquire(&p->lock);
+  release(&wait_lock);
+  p->xstate = status;
+  p->state = ZOMBIE;
+  sched();
+  panic("zombie exit");
+}
+
+// Kill p's other threads and wait until they have exited,
+// leaving p the only user of its memory and files. Used by
+// exit() and exec().
+void
+killthreads(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  struct proc *q;
+
+  acquire(&mm->lock);
+  while(mm->ref > 1){
+    release(&mm->lock);
+    // look again after each wakeup, since a thread being
+    // killed might have been in the middle of clone().
+    for(q = proc; q < &proc[NPROC]; q++){
+      if(q == p)
+        continue;
+      acquire(&q->lock);
+      if(q->mm == mm){
+        q->killed = 1;
+        if(q->state == SLEEPING)
+          q->state = RUNNABLE;
+      }
+      release(&q->lock);
+    }
+    acquire(&mm->lock);
+    if(mm->ref > 1)
+      sleep(mm, &mm->lock);
+  }
+  release(&mm->lock);
+}
+
 // Per-CPU process scheduler. (每个CPU都有一个Scheduler，每个CPU遍历所有进程调度)
 // struct cpu提供了每隔调度器进程运行的状态上下文(寄存器) 当跳转到scheduler的时候执行C代码是在machine mode的start.c中定义的stack0(per-CPU的内核栈)
 // Each CPU calls scheduler() after setting itself up.
@@ -527,6 +1021,11 @@ scheduler(void)
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+
+        // no one waits for a thread; it's gone now that
+        // it is off its kernel stack.
+        if(p->state == ZOMBIE && p->thread)
+          freeproc(p);
       }
       release(&p->lock);
     }
@@ -659,16 +1158,83 @@ wakeup(void *chan)
   }
 }
 
-// Wake up p if it is sleeping in wait(); used by exit().
-// Caller 'must hold' p->lock.
-static void
-wakeup1(struct proc *p)
+// Wake up p if it is sleeping on chan, without a scan of
+// the process table. Must be called without p->lock.
+void
+wakeproc(struct proc *p, void *chan)
 {
-  if(!holding(&p->lock))
-    panic("wakeup1");
-  if(p->chan == p && p->state == SLEEPING) {
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan)
     p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// Wake up at most n processes sleeping on chan, and return
+// how many. Must be called without any p->lock.
+static int
+wakeupn(void *chan, int n)
+{
+  struct proc *p;
+  int woken;
+
+  woken = 0;
+  for(p = proc; p < &proc[NPROC] && woken < n; p++) {
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      p->state = RUNNABLE;
+      woken++;
+    }
+    release(&p->lock);
+  }
+  return woken;
+}
+
+// Fast user-space locking. futex(addr, FUTEX_WAIT, val) sleeps
+// if the int at user address addr still holds val, until a
+// FUTEX_WAKE on addr or a kill(); it returns -1 at once if the
+// value differs. futex(addr, FUTEX_WAKE, n) wakes at most n
+// sleepers and returns how many. The sleep channel is the
+// int's physical address, so every thread sharing the page
+// finds the same one.
+int
+futex(uint64 addr, int op, int val)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  void *chan;
+  int v;
+
+  if(addr % sizeof(int))
+    return -1;
+  // fault the page in, since we can't under futex_lock.
+  if(copyin(p->pagetable, (char*)&v, addr, sizeof(v)) < 0)
+    return -1;
+
+  acquire(&futex_lock);
+  if((pa = walkaddr(p->pagetable, addr)) == 0 || pa == -1){
+    // another thread unmapped it meanwhile.
+    release(&futex_lock);
+    return -1;
+  }
+  chan = (void*)(pa + addr % PGSIZE);
+  switch(op){
+  case FUTEX_WAIT:
+    // a waker changes the value before taking futex_lock
+    // to wake us, so we can't miss it.
+    if(*(int*)chan != val){
+      release(&futex_lock);
+      return -1;
+    }
+    sleep(chan, &futex_lock);
+    release(&futex_lock);
+    return 0;
+  case FUTEX_WAKE:
+    v = wakeupn(chan, val);
+    release(&futex_lock);
+    return v;
   }
+  release(&futex_lock);
+  return -1;
 }
 
 // Kill the process with the given pid.
@@ -684,20 +1250,15 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){   // 减少等待，不会让等待输入的进程等到很久之后输入了再被kill
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = pidlookup(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){   // 减少等待，不会让等待输入的进程等到很久之后输入了再被kill
+    // Wake process from sleep().
+    p->state = RUNNABLE;
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -738,6 +1299,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -81,30 +81,92 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+// A region of a process's memory that maps a file; see mmap.c.
+struct vma {
+  uint64 addr;        // first address, page-aligned
+  uint64 len;         // length in bytes, a multiple of PGSIZE
+  int prot;           // PROT_READ etc.
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+  struct file *f;     // the mapped file, or 0 if the slot is free
+  uint off;           // file offset of addr
+};
+
+// A loadable segment of the program a process is running. exec()
+// records these instead of reading the program in, and vmfault()
+// fills their pages from the program file on first touch.
+struct seg {
+  uint64 addr;        // first address, page-aligned; 0 len if unused
+  uint64 len;         // bytes of memory (the ELF memsz)
+  uint64 filesz;      // bytes of those that come from the file
+  uint off;           // file offset of addr
+  int perm;           // PTE_R etc. for the segment's pages
+};
+
+// A process's memory, shared by all of its threads (see clone()).
+// The page table itself stays in each thread's struct proc, where
+// the rest of the kernel looks for it, but is the same for them all.
+struct mm {
+  struct spinlock lock;
+
+  // lock must be held when using these:
+  int ref;                     // Threads using it; 0 if unused
+  uint tslots;                 // THREADFRAME() slots in use
+
+  // lock must be held to add pages, or change sz or the vmas.
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 heap;                 // Where the heap starts, above the stack
+  struct ring *ring;           // Queues mapped at RING, or 0
+  struct vma vma[NVMA];        // Memory-mapped files
+  struct inode *exe;           // Program file the segments come from
+  struct seg seg[NSEG];        // Program segments, paged in on demand
+};
+
+// A process's open files and current directory, shared by its threads.
+struct files {
+  struct spinlock lock;
+
+  // lock must be held when using these:
+  int ref;                     // Threads using it; 0 if unused
+  struct file **ofile;         // Open files: ofile0, or a page
+  int nofile;                  // Entries in ofile
+  int nextfd;                  // No free descriptor below this
+  struct file *ofile0[NOFILE];
+
+  struct inode *cwd;           // Current directory
+};
+
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
   struct spinlock lock;
 
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process
+  struct proc *child;          // First child
+  struct proc *sibling;        // Next child of the same parent
+
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  struct proc *parent;         // Parent process
   void *chan;                  // If non-zero, sleeping on chan 「chan相当于标记同一个等待队列 在睡眠唤醒时 唤醒会唤醒用一个等待队列上的」
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int vfork;                   // Running in the parent's memory since vfork()
+  int thread;                  // Created by clone(); not waited for
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack     // 用户进程的内核线程执行时使用的函数栈空间
-  uint64 sz;                   // Size of process memory (bytes)      // 程序的heap向上拓展，sz即为sbrk拓展heap的位置 https://i.loli.net/2021/11/29/jInyDJB9Yog8QxN.png
   pagetable_t pagetable;       // User page table
+  struct mm *mm;               // Memory, shared with the other threads   // 程序的heap向上拓展，mm->sz即为sbrk拓展heap的位置 https://i.loli.net/2021/11/29/jInyDJB9Yog8QxN.png
+  struct files *files;         // Open files and cwd, shared likewise
+  int tslot;                   // trapframe is mapped at THREADFRAME(tslot)
+  uint64 ctid;                 // user address to clear at exit, or 0
+  struct proc *pidnext;        // pid hash chain, protected by pid_lock
 
   // 两类寄存器 -- 用户进程寄存器(保存至trapframe)  用户进程的内核线程的寄存器(保存至context) 还有一种调度器内核线程寄存器在CPU struct中
   struct trapframe *trapframe; // data page for trampoline.S          // 切入内核时需要保存到的"用户空间状态" 内含PC指针(program counter)
   struct context context;      // swtch() here to run process         // 用户进程进入内核运行其所属的内核线程，context是内核线程的内核寄存器
-  
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+
   char name[16];               // Process name (debugging)
 };
@@ -0,0 +1,45 @@
+// Submission and completion queues shared by a process and the
+// kernel; see ringsetup() and ringenter() in sysfile.c.
+//
+// The process fills sq[sqtail % RINGSIZE] and advances sqtail;
+// ringenter() carries out entries from sqhead, advancing it, and
+// posts a completion for each at cq[cqtail % RINGSIZE]. The
+// process consumes completions from cqhead.
+
+#define RINGSIZE 64
+
+// ringsqe.op
+#define RING_READ   1  // read(fd, addr, n)
+#define RING_WRITE  2  // write(fd, addr, n)
+#define RING_OPEN   3  // open(addr, n)
+#define RING_CLOSE  4  // close(fd)
+#define RING_FSTAT  5  // fstat(fd, addr)
+
+// An fd of RING_PREV means the descriptor returned by the latest
+// RING_OPEN in the same ringenter() call, so that an open, the
+// operations on the new file, and its close can go in one batch.
+#define RING_PREV  (-2)
+
+struct ringsqe {
+  int op;
+  int fd;
+  uint64 addr;
+  int n;
+  int pad;
+  uint64 data;   // copied to the completion, for the caller's use
+};
+
+struct ringcqe {
+  uint64 data;
+  int res;       // what the system call would have returned
+  int pad;
+};
+
+struct ring {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct ringsqe sq[RINGSIZE];
+  struct ringcqe cq[RINGSIZE];
+};
@@ -335,6 +335,7 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_D (1L << 7) // written since the bit was last cleared
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)     // 某个物理页中所有地址的12~55位都是一样的 0~11位不一样 是各自在页中的offset
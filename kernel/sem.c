@@ -0,0 +1,157 @@
+//
+// Named counting semaphores.
+//
+// semopen(name, value) returns a file descriptor for the semaphore
+// called name, creating it with the given value if no open file
+// refers to one by that name; a semaphore goes away when its last
+// descriptor is closed. semwait() takes one from the value, sleeping
+// while it is zero, and sempost() adds one.
+//
+// Each semaphore keeps its own FIFO queue of waiters, and sempost()
+// hands its token straight to the first of them and wakes only that
+// process, rather than bumping the value and scanning the process
+// table in wakeup() for every sleeper to race for it.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+
+// A process sleeping in semwait(), on its own kernel stack.
+struct semwaiter {
+  struct proc *p;
+  struct semwaiter *next;
+  int granted;        // sempost() gave this waiter a token
+};
+
+struct sem {
+  struct spinlock lock;
+  int ref;            // open files; 0 if free. protected by semtable.lock
+  char name[SEMNAME];
+
+  // lock must be held when using these:
+  int value;
+  struct semwaiter *head;   // waiters, oldest first
+  struct semwaiter *tail;
+};
+
+struct {
+  struct spinlock lock;
+  struct sem sem[NSEM];
+} semtable;
+
+void
+seminit(void)
+{
+  struct sem *s;
+
+  initlock(&semtable.lock, "semtable");
+  for(s = semtable.sem; s < &semtable.sem[NSEM]; s++)
+    initlock(&s->lock, "sem");
+}
+
+// Return the semaphore called name with a new reference,
+// creating it with value if there isn't one. Returns 0 if
+// the table is full.
+struct sem*
+semget(char *name, int value)
+{
+  struct sem *s, *free;
+
+  acquire(&semtable.lock);
+  free = 0;
+  for(s = semtable.sem; s < &semtable.sem[NSEM]; s++){
+    if(s->ref > 0 && strncmp(s->name, name, SEMNAME) == 0){
+      s->ref++;
+      release(&semtable.lock);
+      return s;
+    }
+    if(free == 0 && s->ref == 0)
+      free = s;
+  }
+  if(free){
+    free->ref = 1;
+    safestrcpy(free->name, name, SEMNAME);
+    free->value = value;
+    free->head = free->tail = 0;
+  }
+  release(&semtable.lock);
+  return free;
+}
+
+// Drop a reference, as fileclose() does for the last
+// descriptor of an FD_SEM file.
+void
+semput(struct sem *s)
+{
+  acquire(&semtable.lock);
+  if(s->ref < 1)
+    panic("semput");
+  s->ref--;
+  release(&semtable.lock);
+}
+
+// Take one from s, sleeping until that is possible.
+// Returns 0, or -1 if the process was killed while waiting.
+int
+semwait(struct sem *s)
+{
+  struct proc *p = myproc();
+  struct semwaiter w, **wp;
+
+  acquire(&s->lock);
+  if(s->value > 0){
+    s->value--;
+    release(&s->lock);
+    return 0;
+  }
+
+  w.p = p;
+  w.next = 0;
+  w.granted = 0;
+  if(s->tail)
+    s->tail->next = &w;
+  else
+    s->head = &w;
+  s->tail = &w;
+
+  while(!w.granted){
+    if(p->killed){
+      // leave the queue.
+      for(wp = &s->head; *wp != &w; wp = &(*wp)->next)
+        ;
+      *wp = w.next;
+      if(s->tail == &w)
+        for(s->tail = s->head; s->tail && s->tail->next; s->tail = s->tail->next)
+          ;
+      release(&s->lock);
+      return -1;
+    }
+    sleep(&w, &s->lock);
+  }
+  release(&s->lock);
+  return 0;
+}
+
+// Add one to s, giving it to the oldest waiter if there is one.
+void
+sempost(struct sem *s)
+{
+  struct semwaiter *w;
+
+  acquire(&s->lock);
+  if((w = s->head) == 0){
+    s->value++;
+    release(&s->lock);
+    return;
+  }
+  s->head = w->next;
+  if(s->head == 0)
+    s->tail = 0;
+  w->granted = 1;
+  wakeproc(w->p, w);
+  release(&s->lock);
+}
@@ -0,0 +1,186 @@
+//
+// Object caches for small fixed-size kernel structures.
+//
+// A cache hands out objects of one size, carved from whole pages
+// taken with kalloc(). Each page (a slab) starts with a header
+// that keeps the page's own list of free objects and how many are
+// in use, so the slab an object belongs to is just the page it is
+// in, and a slab whose objects are all free can go back to kfree().
+//
+// In front of the slabs each CPU has a magazine: a small stack of
+// free objects that slaballoc() pops and slabfree() pushes with
+// interrupts off and no lock at all. Only when a magazine runs
+// empty or full does a CPU take the cache's lock, to move half a
+// magazine of objects between it and the slabs.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slabcache *c;
+  struct slab *next;    // on c->partial, if it has free objects
+  struct slab *prev;
+  void *free;           // free objects, linked through their first word
+  int inuse;            // objects handed out, or in a magazine
+};
+
+#define FIRSTOBJ  ((sizeof(struct slab) + 15) & ~15)
+
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  size = (size + 15) & ~15;
+  if(size < sizeof(void*) || size > PGSIZE - FIRSTOBJ)
+    panic("slabinit");
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - FIRSTOBJ) / size;
+  c->partial = 0;
+  c->nslab = 0;
+  c->nempty = 0;
+  memset(c->mag, 0, sizeof(c->mag));
+}
+
+// Take a page from kalloc() and carve it into free objects.
+// Returns with c->lock held either way.
+static struct slab*
+slabgrow(struct slabcache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  release(&c->lock);
+  s = (struct slab*)kalloc();
+  acquire(&c->lock);
+  if(s == 0)
+    return 0;
+  s->c = c;
+  s->inuse = 0;
+  s->free = 0;
+  o = (char*)s + FIRSTOBJ + (c->perslab - 1) * c->size;
+  for(i = 0; i < c->perslab; i++, o -= c->size){
+    *(void**)o = s->free;
+    s->free = o;
+  }
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+  c->nslab++;
+  c->nempty++;
+  return s;
+}
+
+// Move up to n objects from the slabs into magazine m.
+// Caller must hold c->lock.
+static void
+magfill(struct slabcache *c, struct magazine *m, int n)
+{
+  struct slab *s;
+  void *o;
+
+  while(n > 0){
+    if((s = c->partial) == 0 && (s = slabgrow(c)) == 0)
+      return;
+    if(s->inuse == 0)
+      c->nempty--;
+    for(; n > 0 && (o = s->free) != 0; n--){
+      s->free = *(void**)o;
+      s->inuse++;
+      m->obj[m->n++] = o;
+    }
+    if(s->free == 0){
+      // full: off the partial list.
+      c->partial = s->next;
+      if(s->next)
+        s->next->prev = 0;
+    }
+  }
+}
+
+// Return up to n objects from magazine m to their slabs, and
+// give back to kfree() slabs left empty, except for one.
+// Caller must hold c->lock.
+static void
+magdrain(struct slabcache *c, struct magazine *m, int n)
+{
+  struct slab *s;
+  void *o;
+
+  for(; n > 0 && m->n > 0; n--){
+    o = m->obj[--m->n];
+    s = (struct slab*)PGROUNDDOWN((uint64)o);
+    if(s->c != c)
+      panic("slabfree: wrong cache");
+    if(s->free == 0){
+      // was full: back on the partial list.
+      s->prev = 0;
+      s->next = c->partial;
+      if(c->partial)
+        c->partial->prev = s;
+      c->partial = s;
+    }
+    *(void**)o = s->free;
+    s->free = o;
+    if(--s->inuse > 0)
+      continue;
+    if(c->nempty == 0){
+      c->nempty++;
+      continue;
+    }
+    if(s->prev)
+      s->prev->next = s->next;
+    else
+      c->partial = s->next;
+    if(s->next)
+      s->next->prev = s->prev;
+    c->nslab--;
+    kfree(s);
+  }
+}
+
+// Allocate an object from c. Its contents are undefined.
+// Returns 0 if there is no memory.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *o;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    magfill(c, m, NMAG/2);
+    release(&c->lock);
+  }
+  o = m->n > 0 ? m->obj[--m->n] : 0;
+  pop_off();
+  return o;
+}
+
+// Free an object that slaballoc(c) returned.
+void
+slabfree(struct slabcache *c, void *o)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == NMAG){
+    acquire(&c->lock);
+    magdrain(c, m, NMAG/2);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = o;
+  pop_off();
+}
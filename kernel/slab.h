@@ -0,0 +1,19 @@
+#define NMAG  16   // objects in a per-CPU magazine
+
+// A CPU's stack of free objects; see slab.c.
+struct magazine {
+  int n;
+  void *obj[NMAG];
+};
+
+// Cache of objects of one size.
+struct slabcache {
+  struct spinlock lock;   // protects the slabs
+  char *name;
+  uint size;              // bytes per object
+  int perslab;            // objects per page
+  struct slab *partial;   // slabs with free objects
+  int nslab;              // pages held
+  int nempty;             // slabs on partial with none in use
+  struct magazine mag[NCPU];  // used only by their CPU, interrupts off
+};
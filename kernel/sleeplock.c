@@ -8,6 +8,19 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "stat.h"
+
+// Adaptive locking: a holder that is running on another CPU
+// will likely let go soon, so acquiresleep() first spins,
+// with lk->lk released, for as long as the holder keeps
+// running or up to SPINMAX checks, and only then sleeps. A
+// holder that is itself asleep, or readers, who aren't
+// recorded, mean sleeping straight away. Releasing skips the
+// scan of the process table in wakeup() when nobody sleeps.
+
+#define SPINMAX   10000
+
+static struct sleepstat stats;
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -15,9 +28,33 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->writers = 0;
+  lk->sleepers = 0;
+  lk->owner = 0;
   lk->pid = 0;
 }
 
+// Is the lock held exclusively by a process that is running
+// right now? Looks at the owner's state without its lock, so
+// the answer is only a hint.
+static int
+ownerrunning(struct sleeplock *lk)
+{
+  struct proc *o = lk->owner;
+
+  return lk->locked && o != 0 && o->state == RUNNING;
+}
+
+// Wait, in sleep(), until wakeup(lk). Caller holds lk->lk.
+static void
+sleepon(struct sleeplock *lk)
+{
+  lk->sleepers++;
+  sleep(lk, &lk->lk);
+  lk->sleepers--;
+}
+
 // sleeplock:
 // 未争用到锁时：
 // 1. 保存上下文
@@ -27,14 +64,34 @@ initsleeplock(struct sleeplock *lk, char *name)
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int n;
+
   acquire(&lk->lk);       // 对信号量数据结构lk加锁是为了防止while条件在使用lk->locked后releasesleep解睡眠锁 导致判断条件时值为1 进入循环时值为0 最终导致进程永久睡眠
                           // 它保证了没有其他进程可以调用wakeup(chan)
-  while (lk->locked) {    // r防止lose wakeup
-    sleep(lk, &lk->lk);   // 睡眠锁实现原理与Linux Mutex实现一样，当同一锁被二次争用时陷入到睡眠，睡眠中实现被调度
+  __sync_fetch_and_add(&stats.acquire, 1);
+  if(lk->locked || lk->readers){
+    lk->writers++;
+    for(n = 0; n < SPINMAX && ownerrunning(lk); n++){
+      release(&lk->lk);
+      while(n < SPINMAX && ownerrunning(lk)){
+        __sync_synchronize();
+        n++;
+      }
+      acquire(&lk->lk);
+    }
+    if(!lk->locked && !lk->readers && n > 0)
+      __sync_fetch_and_add(&stats.spin, 1);
+    else
+      __sync_fetch_and_add(&stats.sleep, 1);
+    while (lk->locked || lk->readers) {    // r防止lose wakeup
+      sleepon(lk);        // 睡眠锁实现原理与Linux Mutex实现一样，当同一锁被二次争用时陷入到睡眠，睡眠中实现被调度
                           // https://blog.csdn.net/21cnbao/article/details/119708595
+    }
+    lk->writers--;
   }
   // 能执行到这里说明抢锁成功
   lk->locked = 1;         // 后续抢锁的进来就会进入上面的循环
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
@@ -52,8 +109,41 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);   // 防止在acquiresleep时修改睡眠锁状态导致线程永久睡眠
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
-  wakeup(lk);
+  if(lk->sleepers)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Shared (reader) mode: any number of processes may hold the
+// lock shared at once, but not while one holds it through
+// acquiresleep(). A process waiting in acquiresleep() keeps new
+// readers out, so a stream of readers can't starve it. The
+// lock records no owner in this mode, and a process must not
+// take it shared twice, since a writer may queue in between.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  __sync_fetch_and_add(&stats.shared, 1);
+  if(lk->locked || lk->writers)
+    __sync_fetch_and_add(&stats.sleep, 1);
+  while (lk->locked || lk->writers) {
+    sleepon(lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers < 1)
+    panic("releasesleepshared");
+  if(--lk->readers == 0 && lk->sleepers)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -68,5 +158,9 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
-
-
+// Copy out the counts of how acquires went.
+void
+sleeplockstat(struct sleepstat *st)
+{
+  *st = stats;
+}
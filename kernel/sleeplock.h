@@ -1,8 +1,12 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Processes holding it shared
+  int writers;       // Processes waiting to hold it exclusively
+  int sleepers;      // Processes in sleep() on it
   struct spinlock lk; // spinlock protecting this sleep lock
-  
+  struct proc *owner; // Process holding it exclusively, for spinning
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
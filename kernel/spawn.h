@@ -0,0 +1,17 @@
+// File actions for spawn(), carried out in order on a copy of
+// the caller's open files to give the new process its own.
+
+#define SPAWN_MAXACT 8
+
+// spawnact.op
+#define SPAWN_OPEN   1  // open(path, omode) as fd
+#define SPAWN_DUP    2  // make fd a copy of srcfd, as dup2(srcfd, fd)
+#define SPAWN_CLOSE  3  // close(fd)
+
+struct spawnact {
+  int op;
+  int fd;
+  int srcfd;
+  int omode;
+  char *path;
+};
@@ -9,3 +9,18 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// Name cache statistics, from dcachestat().
+struct dcachestat {
+  uint64 hits;     // path elements found in the name cache
+  uint64 neghits;  // hits that said the name does not exist
+  uint64 misses;   // path elements that needed a directory scan
+};
+
+// Sleep-lock statistics, from sleepstat().
+struct sleepstat {
+  uint64 acquire;  // exclusive acquires
+  uint64 shared;   // shared acquires
+  uint64 spin;     // exclusive acquires that waited by spinning
+  uint64 sleep;    // acquires of either kind that slept
+};
@@ -12,7 +12,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
+  if(addr >= p->mm->sz || addr+sizeof(uint64) > p->mm->sz)
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -104,6 +104,26 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_dcachestat(void);
+extern uint64 sys_pipesize(void);
+extern uint64 sys_vmsplice(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_ringsetup(void);
+extern uint64 sys_ringenter(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_vfork(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_semopen(void);
+extern uint64 sys_semwait(void);
+extern uint64 sys_sempost(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_sleepstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +147,26 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_dcachestat] sys_dcachestat,
+[SYS_pipesize] sys_pipesize,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_readv] sys_readv,
+[SYS_writev] sys_writev,
+[SYS_pread] sys_pread,
+[SYS_pwrite] sys_pwrite,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_mmap] sys_mmap,
+[SYS_munmap] sys_munmap,
+[SYS_spawn] sys_spawn,
+[SYS_vfork] sys_vfork,
+[SYS_clone] sys_clone,
+[SYS_futex] sys_futex,
+[SYS_semopen] sys_semopen,
+[SYS_semwait] sys_semwait,
+[SYS_sempost] sys_sempost,
+[SYS_madvise] sys_madvise,
+[SYS_sleepstat] sys_sleepstat,
 };
 
 // 用户进程通过ecall传入a7寄存器系统调用号进入内核trap trap根据进入内核原因在trap中调用syscall处理系统调用
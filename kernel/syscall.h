@@ -20,3 +20,23 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_dcachestat 22
+#define SYS_pipesize 23
+#define SYS_vmsplice 24
+#define SYS_readv 25
+#define SYS_writev 26
+#define SYS_pread 27
+#define SYS_pwrite 28
+#define SYS_ringsetup 29
+#define SYS_ringenter 30
+#define SYS_mmap 31
+#define SYS_munmap 32
+#define SYS_spawn 33
+#define SYS_vfork 34
+#define SYS_clone 35
+#define SYS_futex 36
+#define SYS_semopen 37
+#define SYS_semwait 38
+#define SYS_sempost 39
+#define SYS_madvise 40
+#define SYS_sleepstat 41
@@ -18,9 +18,33 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "memlayout.h"
+#include "ring.h"
+#include "spawn.h"
+
+// Return the file open at descriptor fd, or 0, with a reference
+// the caller drops with fileclose() when done with it; another
+// thread may close fd meanwhile.
+struct file*
+fdget(int fd)
+{
+  struct files *fs = myproc()->files;
+  struct file *f;
+
+  if(fd < 0)
+    return 0;
+  f = 0;
+  acquire(&fs->lock);
+  if(fd < fs->nofile && fs->ofile[fd])
+    f = filedup(fs->ofile[fd]);
+  release(&fs->lock);
+  return f;
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// as fdget() does.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -29,7 +53,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -38,21 +62,36 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
+// Allocate a file descriptor for the given file: the lowest
+// free one, found from fs->nextfd on, growing the table if it
+// is full. Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct files *fs = myproc()->files;
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
+  acquire(&fs->lock);
+  for(fd = fs->nextfd; fd < fs->nofile; fd++)
+    if(fs->ofile[fd] == 0)
+      break;
+  if(fd == fs->nofile && filesgrow(fs) < 0){
+    release(&fs->lock);
+    return -1;
   }
-  return -1;
+  fs->ofile[fd] = f;
+  fs->nextfd = fd + 1;
+  release(&fs->lock);
+  return fd;
+}
+
+// Free descriptor fd. Caller must hold fs->lock.
+static void
+fdfree(struct files *fs, int fd)
+{
+  fs->ofile[fd] = 0;
+  if(fd < fs->nextfd)
+    fs->nextfd = fd;
 }
 
 uint64
@@ -63,9 +102,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -73,25 +113,132 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
+}
+
+// Fetch the iovec array and count that are the nth and n+1th
+// system call arguments of readv() or writev(). The lengths must
+// add up to no more than an int, which the call returns.
+static int
+argiov(int n, struct iovec *iov, int *cnt)
+{
+  uint64 uiov, total;
+  int i;
+
+  if(argaddr(n, &uiov) < 0 || argint(n+1, cnt) < 0)
+    return -1;
+  if(*cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, *cnt * sizeof(struct iovec)) < 0)
+    return -1;
+  total = 0;
+  for(i = 0; i < *cnt; i++){
+    if(iov[i].iov_len >= (1L << 31))
+      return -1;
+    total += iov[i].iov_len;
+  }
+  if(total >= (1L << 31))
+    return -1;
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int i, cnt, n, total;
+
+  if(argiov(1, iov, &cnt) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  total = 0;
+  for(i = 0; i < cnt; i++){
+    if((n = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    total += n;
+    if(n < iov[i].iov_len)
+      break;
+  }
+  fileclose(f);
+  return total;
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int i, cnt, n, total;
+
+  if(argiov(1, iov, &cnt) < 0 || argfd(0, 0, &f) < 0)
     return -1;
+  total = 0;
+  for(i = 0; i < cnt; i++){
+    if((n = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    total += n;
+    if(n < iov[i].iov_len)
+      break;
+  }
+  fileclose(f);
+  return total;
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off, r;
+  uint64 p;
 
-  return filewrite(f, p, n);
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     argfd(0, 0, &f) < 0)
+    return -1;
+  r = filepread(f, p, n, off);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off, r;
+  uint64 p;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     argfd(0, 0, &f) < 0)
+    return -1;
+  r = filepwrite(f, p, n, off);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -99,11 +246,21 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct files *fs = myproc()->files;
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
+  acquire(&fs->lock);
+  if(fs->ofile[fd] != f){
+    // another thread closed it meanwhile.
+    release(&fs->lock);
+    fileclose(f);
+    return -1;
+  }
+  fdfree(fs, fd);
+  release(&fs->lock);
+  fileclose(f);   // fd's reference
+  fileclose(f);   // argfd()'s
   return 0;
 }
 
@@ -112,10 +269,13 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -188,7 +348,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -218,9 +377,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -286,17 +443,25 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
+static int openfile(char*, int);
+
 uint64
 sys_open(void)
 {
   char path[MAXPATH];
-  int fd, omode;
-  struct file *f;
-  struct inode *ip;
-  int n;
+  int omode;
 
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
     return -1;
+  return openfile(path, omode);
+}
+
+// Open path with mode omode and return the open file, or 0.
+static struct file*
+openpath(char *path, int omode)
+{
+  struct file *f;
+  struct inode *ip;
 
   begin_op();
 
@@ -304,33 +469,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -351,6 +514,23 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+// Open path with mode omode in the current process and
+// return the new file descriptor, or -1.
+static int
+openfile(char *path, int omode)
+{
+  struct file *f;
+  int fd;
+
+  if((f = openpath(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -394,7 +574,7 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
+  struct inode *ip, *old;
   struct proc *p = myproc();
   
   begin_op();
@@ -409,29 +589,31 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&p->files->lock);
+  old = p->files->cwd;
+  p->files->cwd = ip;
+  release(&p->files->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user's argv array at uargv into argv[MAXARG],
+// copying each string into a page of its own.
+// Returns 0, or -1 with argv to be freed by freeargv().
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
+  uint64 uarg;
   int i;
-  uint64 uargv, uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
@@ -439,22 +621,115 @@ sys_exec(void)
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+  return 0;
+}
 
-  int ret = exec(path, argv);
+static void
+freeargv(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
 
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Carry out spawn()'s file actions on ofile, a copy of the
+// caller's open files.
+static int
+spawnfiles(struct file **ofile, struct spawnact *act, int nact)
+{
+  char path[MAXPATH];
+  struct file *f;
+  int i;
+
+  for(i = 0; i < nact; i++){
+    if(act[i].fd < 0 || act[i].fd >= NOFILEMAX)
+      return -1;
+    switch(act[i].op){
+    case SPAWN_OPEN:
+      if(fetchstr((uint64)act[i].path, path, MAXPATH) < 0 ||
+         (f = openpath(path, act[i].omode)) == 0)
+        return -1;
+      break;
+    case SPAWN_DUP:
+      if(act[i].srcfd < 0 || act[i].srcfd >= NOFILEMAX || (f = ofile[act[i].srcfd]) == 0)
+        return -1;
+      filedup(f);
+      break;
+    case SPAWN_CLOSE:
+      f = 0;
+      break;
+    default:
+      return -1;
+    }
+    if(ofile[act[i].fd])
+      fileclose(ofile[act[i].fd]);
+    ofile[act[i].fd] = f;
+  }
+  return 0;
+}
+
+// int spawn(char *path, char **argv, struct spawnact *act, int nact)
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnact act[SPAWN_MAXACT];
+  struct file **ofile;
+  struct files *fs = myproc()->files;
+  struct proc *p = myproc();
+  uint64 uargv, uact;
+  int i, nact, pid;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &uact) < 0 || argint(3, &nact) < 0)
+    return -1;
+  if(nact < 0 || nact > SPAWN_MAXACT)
+    return -1;
+  if(copyin(p->pagetable, (char*)act, uact, nact*sizeof(act[0])) < 0)
+    return -1;
+
+  // a copy of the caller's descriptors, in a table as big as
+  // any process may have, for the file actions to work on.
+  if((ofile = kalloc()) == 0)
+    return -1;
+  memset(ofile, 0, PGSIZE);
+  pid = -1;
+  acquire(&fs->lock);
+  for(i = 0; i < fs->nofile; i++)
+    ofile[i] = fs->ofile[i] ? filedup(fs->ofile[i]) : 0;
+  release(&fs->lock);
+  if(fetchargv(uargv, argv) == 0 && spawnfiles(ofile, act, nact) == 0)
+    pid = spawn(path, argv, ofile);
+  if(pid < 0){
+    for(i = 0; i < NOFILEMAX; i++)
+      if(ofile[i])
+        fileclose(ofile[i]);
+  }
+  kfree(ofile);
+  freeargv(argv);
+  return pid;
 }
 
 uint64
@@ -471,19 +746,252 @@ sys_pipe(void)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+    if(fd0 >= 0){
+      acquire(&p->files->lock);
+      fdfree(p->files, fd0);
+      release(&p->files->lock);
+    }
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    acquire(&p->files->lock);
+    fdfree(p->files, fd0);
+    fdfree(p->files, fd1);
+    release(&p->files->lock);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_dcachestat(void)
+{
+  uint64 addr; // user pointer to struct dcachestat
+  struct dcachestat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  dcstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Resize the ring of the pipe fd refers to; see piperesize().
+uint64
+sys_pipesize(void)
+{
+  struct file *f;
+  int n, r;
+
+  if(argint(1, &n) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_PIPE)
+    r = piperesize(f->pipe, n);
+  fileclose(f);
+  return r;
+}
+
+// int semopen(char *name, int value)
+// Return a descriptor for the named semaphore, creating it with
+// value if it isn't open anywhere; close() the descriptor when done.
+uint64
+sys_semopen(void)
+{
+  char name[SEMNAME];
+  struct sem *s;
+  struct file *f;
+  int value, fd;
+
+  if(argstr(0, name, SEMNAME) < 0 || argint(1, &value) < 0 || value < 0)
+    return -1;
+  if((s = semget(name, value)) == 0)
+    return -1;
+  if((f = filealloc()) == 0){
+    semput(s);
+    return -1;
+  }
+  f->type = FD_SEM;
+  f->sem = s;
+  f->readable = 0;
+  f->writable = 0;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+uint64
+sys_semwait(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_SEM)
+    r = semwait(f->sem);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_sempost(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_SEM){
+    sempost(f->sem);
+    r = 0;
+  }
+  fileclose(f);
+  return r;
+}
+
+// Like write() or read() on a pipe, but whole page-aligned pages
+// move between the caller and the pipe by reference. Pages given
+// to the pipe read back as zeros afterwards.
+uint64
+sys_vmsplice(void)
+{
+  struct file *f;
+  int n, r;
+  uint64 p;
+
+  if(myproc()->vfork)
+    return -1;  // see vfork()
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_PIPE && f->writable)
+    r = pipewrite(f->pipe, p, n, 1);
+  else if(f->type == FD_PIPE)
+    r = piperead(f->pipe, p, n, 1);
+  fileclose(f);
+  return r;
+}
+
+// Map a fresh pair of submission and completion queues at RING
+// and return that address. A process has at most one pair; they
+// are not inherited by fork() and do not survive exec().
+uint64
+sys_ringsetup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(p->vfork)
+    return -1;  // see vfork()
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  acquire(&p->mm->lock);
+  if(p->mm->ring){
+    // already set up, perhaps by another thread.
+    release(&p->mm->lock);
+    kfree(mem);
+    return RING;
+  }
+  if(mappages(p->pagetable, RING, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    release(&p->mm->lock);
+    kfree(mem);
+    return -1;
+  }
+  p->mm->ring = (struct ring*)mem;
+  release(&p->mm->lock);
+  return RING;
+}
+
+// Unmap and free p's queues from pagetable.
+void
+ringfree(struct proc *p, pagetable_t pagetable)
+{
+  uvmunmap(pagetable, RING, 1, 1);
+  p->mm->ring = 0;
+}
+
+// Carry out one submission entry. *lastfd is the result of the
+// latest RING_OPEN in this ringenter() call.
+static int
+ringop(struct ringsqe *sqe, int *lastfd)
+{
+  struct proc *p = myproc();
+  char path[MAXPATH];
+  struct file *f;
+  int fd, r;
+
+  if(sqe->op == RING_OPEN){
+    if(fetchstr(sqe->addr, path, MAXPATH) < 0)
+      return *lastfd = -1;
+    return *lastfd = openfile(path, sqe->n);
+  }
+
+  fd = sqe->fd == RING_PREV ? *lastfd : sqe->fd;
+  if((f = fdget(fd)) == 0)
+    return -1;
+  r = -1;
+  switch(sqe->op){
+  case RING_READ:
+    r = fileread(f, sqe->addr, sqe->n);
+    break;
+  case RING_WRITE:
+    r = filewrite(f, sqe->addr, sqe->n);
+    break;
+  case RING_CLOSE:
+    acquire(&p->files->lock);
+    if(p->files->ofile[fd] != f){
+      release(&p->files->lock);
+      break;
+    }
+    fdfree(p->files, fd);
+    release(&p->files->lock);
+    fileclose(f);   // fd's reference
+    r = 0;
+    break;
+  case RING_FSTAT:
+    r = filestat(f, sqe->addr);
+    break;
+  }
+  fileclose(f);
+  return r;
+}
+
+// Carry out up to n queued submissions, stopping early if the
+// submission queue empties or the completion queue fills.
+// Returns the number of submissions consumed.
+uint64
+sys_ringenter(void)
+{
+  struct ring *r = myproc()->mm->ring;
+  struct ringsqe sqe;
+  struct ringcqe *cqe;
+  int i, n, lastfd;
+
+  if(argint(0, &n) < 0 || r == 0)
+    return -1;
+  lastfd = -1;
+  for(i = 0; i < n; i++){
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead >= RINGSIZE)
+      break;
+    // the process can change the entry under us; work on a copy.
+    sqe = r->sq[r->sqhead % RINGSIZE];
+    r->sqhead++;
+    cqe = &r->cq[r->cqtail % RINGSIZE];
+    cqe->res = ringop(&sqe, &lastfd);
+    cqe->data = sqe.data;
+    r->cqtail++;
+  }
+  return i;
+}
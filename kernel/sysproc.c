@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "stat.h"
 
 uint64
 sys_exit(void)
@@ -29,6 +30,36 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_vfork(void)
+{
+  return vfork();
+}
+
+// int clone(void (*fn)(void*), void *arg, void *stack, int *ctid)
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack, ctid;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 ||
+     argaddr(2, &stack) < 0 || argaddr(3, &ctid) < 0)
+    return -1;
+  return clone(fn, arg, stack, ctid);
+}
+
+// int futex(int *addr, int op, int val)
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
+
 uint64
 sys_wait(void)
 {
@@ -39,27 +70,41 @@ sys_wait(void)
 }
 
 // Xv6 applications ask the kernel for `heap` memory using the sbrk() system call.
-// Lazy allocation only increases `p->sz` in sys_sbrk().
+// Lazy allocation only increases `p->mm->sz` in sys_sbrk().
 // The process uses unallocate memory virtual address leading to page fault after sbrk.
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
   struct proc* p = myproc();
 
   if(argint(0, &n) < 0)
     return -1;
+  if(p->vfork)
+    return -1;  // the memory belongs to the parent
 
-  addr = p->sz;
+  // the process's threads share sz.
+  acquire(&p->mm->lock);
+  addr = p->mm->sz;
 
-  // deallocation
+  // deallocation: free the pages above the new break now.
   if (n < 0) {
-    // We should negative sbrk() arguments.
-    p->sz = uvmdealloc(p->pagetable, PGROUNDDOWN(p->sz), PGROUNDDOWN(p->sz) + n);        // BUG still?
+    // other threads may hold the pages in their TLBs; see sys_munmap().
+    if(-(uint64)n > addr || p->mm->ref > 1){
+      release(&p->mm->lock);
+      return -1;
+    }
+    p->mm->sz = uvmdealloc(p->pagetable, addr, addr + n);
+    segtrim(p);
   } else if (n > 0) {
-    p->sz += n;
+    if(p->mm->sz + n > mmapbase(p)){
+      release(&p->mm->lock);
+      return -1;
+    }
+    p->mm->sz += n;
   }
+  release(&p->mm->lock);
   
   return addr;
 }
@@ -107,3 +152,17 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_sleepstat(void)
+{
+  uint64 addr; // user pointer to struct sleepstat
+  struct sleepstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  sleeplockstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
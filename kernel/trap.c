@@ -84,46 +84,16 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
-  } else if (r_scause() == 13 || r_scause() == 15) {    // Page faluts
-    // printf("== %p ==\n", r_sepc());
-    // vmprint(p->pagetable, 0);
-
-    if (r_stval() > p->sz || r_stval() < PGROUNDDOWN(p->trapframe->sp)) {
-      p->killed = 1;
-      goto kill;
-    }
-
-
-    // Create PTEs and allocate a new page for lazy allocation.
-    uint64 oldsz = PGROUNDDOWN(r_stval());
-    uint64 mem = (uint64)kalloc();
-    if(mem == 0){
-      uvmdealloc(p->pagetable, oldsz, r_stval());
-      p->killed = 1;      // Out of Memory (没有物理内存可供分配了，这里还有更巧妙处理方法，例如clock、LRU算法来evict pages)
-      goto kill;
-
-    }
-    memset((void*)mem, 0, PGSIZE);
-    if(mappages(p->pagetable, oldsz, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_U) != 0){
-      kfree((void*)mem);
-      uvmdealloc(p->pagetable, oldsz, r_stval());
-      panic("page faults handler falut");
-    }
-
-    // That's fine
-    // if(uvmalloc(p->pagetable, PGROUNDDOWN(r_stval()), PGROUNDDOWN(r_stval())+PGSIZE) == 0) {
-    //   panic("xdd");
-    // }
-
-    // printf("=================================\n");
-    // vmprint(p->pagetable, 0);
+  } else if (r_scause() == 12 || r_scause() == 13 || r_scause() == 15) {    // Page faluts: instruction, load, store
+    // lazily allocated heap, a page of a mapped file, or of the program.
+    if(vmfault(p, r_stval(), r_scause() == 15) < 0)
+      p->killed = 1;      // bad address, or Out of Memory
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     p->killed = 1;
   }
 
-kill:
   if(p->killed)
     exit(-1);
 
@@ -176,7 +146,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(THREADFRAME(p->tslot), satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -0,0 +1,7 @@
+// One buffer of a readv() or writev() call.
+struct iovec {
+  void *iov_base;  // start of the buffer
+  uint64 iov_len;  // its length in bytes
+};
+
+#define IOV_MAX 16  // most buffers in one call
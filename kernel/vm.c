@@ -120,7 +120,9 @@ walkaddr(pagetable_t pagetable, uint64 va)
   pte = walk(pagetable, va, 0);
   if(pte == 0 || (*pte & PTE_V) == 0)  // Invaild address OR 合法虚拟地址空间地址但没被映射由于lazy allocation
   {
-    if ((va >= myproc()->sz || va <= PGROUNDDOWN(myproc()->trapframe->sp))) {  // Invaild address
+    if(vmalookup(myproc(), va) || seglookup(myproc(), va))   // a file or program page not read in yet
+      return -1;
+    if (va >= myproc()->mm->sz || va < myproc()->mm->heap) {  // Invaild address
       return 0;
     }
     return -1;
@@ -212,8 +214,12 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
+    if((pte = walk(pagetable, a, 0)) == 0){
+      // no page-table page, so nothing is mapped up to the
+      // next 2MB boundary; a lazily grown heap is mostly holes.
+      a = (a | (512*PGSIZE - 1)) + 1 - PGSIZE;
       continue;
+    }
       // panic("uvmunmap: walk");
     if((*pte & PTE_V) == 0)
       continue;
@@ -346,18 +352,26 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // its memory into a child's page table.
 // """""Copies both the page table and the"""""
 // """""physical memory."""""
+// Read-only pages are shared instead.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 // fork() -> uvmcopy()
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return uvmcopyrange(old, new, 0, sz);
+}
+
+// Like uvmcopy(), for the pages of [start, end) that are present.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
 {
   pte_t *pte;
   uint64 pa, i;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       continue;
       // panic("uvmcopy: pte should exist");
@@ -366,6 +380,16 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       // panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if((flags & PTE_W) == 0){
+      // nobody can write the page, program text say,
+      // so the child can share it.
+      kref((void*)pa);
+      if(mappages(new, i, PGSIZE, pa, flags) != 0){
+        kfree((void*)pa);
+        goto err;
+      }
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -377,7 +401,7 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
@@ -394,6 +418,74 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Can page va of the current process be handed over with
+// uvmtake() or uvmgive()? Only heap and data pages above the
+// stack qualify, since the page-fault handler can bring those
+// back as zero pages. And not while the process has other
+// threads, which may have the old page in their TLBs (see
+// sys_munmap()); the caller copies instead.
+// Caller must hold p->mm->lock.
+static int
+uvmmovable(uint64 va)
+{
+  struct proc *p = myproc();
+
+  return va % PGSIZE == 0 && va < p->mm->sz && va >= p->mm->heap &&
+         p->mm->ref == 1;
+}
+
+// Unmap the user page at va and return its physical address,
+// now owned by the caller. The process sees a zero page there
+// the next time it touches va, as with lazy allocation.
+// Returns 0 if va is not a mapped, movable user page.
+uint64
+uvmtake(pagetable_t pagetable, uint64 va)
+{
+  struct mm *mm = myproc()->mm;
+  pte_t *pte;
+  uint64 pa;
+
+  acquire(&mm->lock);
+  pa = 0;
+  if(uvmmovable(va) && (pte = walk(pagetable, va, 0)) != 0 &&
+     (*pte & (PTE_V|PTE_U|PTE_W)) == (PTE_V|PTE_U|PTE_W)){
+    pa = PTE2PA(*pte);
+    *pte = 0;
+    sfence_vma();
+  }
+  release(&mm->lock);
+  return pa;
+}
+
+// Map physical page pa at user address va in place of the page
+// that was there, handing the old page to the caller in *old
+// (0 if va had not been touched yet).
+// Returns -1 if va is not a movable user page.
+int
+uvmgive(pagetable_t pagetable, uint64 va, uint64 pa, uint64 *old)
+{
+  struct mm *mm = myproc()->mm;
+  pte_t *pte;
+
+  acquire(&mm->lock);
+  if(!uvmmovable(va) || (pte = walk(pagetable, va, 1)) == 0){
+    release(&mm->lock);
+    return -1;
+  }
+  if(*pte & PTE_V){
+    if((*pte & (PTE_U|PTE_W)) != (PTE_U|PTE_W)){
+      release(&mm->lock);
+      return -1;
+    }
+    *old = PTE2PA(*pte);
+  } else
+    *old = 0;
+  *pte = PA2PTE(pa) | PTE_W|PTE_R|PTE_U|PTE_V;
+  sfence_vma();
+  release(&mm->lock);
+  return 0;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -401,35 +493,28 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     pa0 = walkaddr(pagetable, va0);
 
-    if(pa0 == -1) {
+    if(pa0 == -1){
       // 合法虚拟地址空间地址但没被映射由于lazy allocation
-      char* mem = (char*)kalloc();
-      if(mem == 0){
-        panic("Lazy allocation failed: out of memory");
-      }
-      memset((void*)mem, 0, PGSIZE);
-      // map
-      if(mappages(pagetable, PGROUNDDOWN(va0), PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_U) != 0){
-        kfree((void*)mem);
-        uvmdealloc(pagetable, PGROUNDUP(va0), PGROUNDDOWN(va0));
-        panic("Lazy allocation failed");
-      }
-      pa0 = PTE2PA(*walk(pagetable, va0, 0));
+      if(vmfault(myproc(), va0, 1) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
     }
-
-
     if(pa0 == 0)
       return -1;
+    pte = walk(pagetable, va0, 0);
+    if((*pte & PTE_W) == 0)
+      return -1;
+    *pte |= PTE_D;    // as a store from user space would; see vmawriteback()
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
-    if(pa0 != -1)
-      memmove((void *)(pa0 + (dstva - va0)), src, n);
+    memmove((void *)(pa0 + (dstva - va0)), src, n);
 
     len -= n;
     src += n;
@@ -450,6 +535,11 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == -1){
+      if(vmfault(myproc(), va0, 0) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+    }
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -477,6 +567,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == -1){
+      if(vmfault(myproc(), va0, 0) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+    }
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,69 @@
+// Measure the cost of opening and closing files: open() and
+// close() of one file, pipe() and close() of both ends, and
+// filling a descriptor table well past NOFILE with dup() and
+// emptying it again, which grows the table and then reuses the
+// lowest free descriptor each time.
+//
+// usage: fdbench [count]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NHOLD 400
+
+int fds[NHOLD];
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, fd, p[2], t;
+
+  n = argc > 1 ? atoi(argv[1]) : 2000;
+
+  if((fd = open("fdbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf("fdbench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if((fd = open("fdbench.tmp", O_RDONLY)) < 0){
+      printf("fdbench: open failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  printf("%d open/close: %d ticks\n", n, uptime() - t);
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(pipe(p) < 0){
+      printf("fdbench: pipe failed\n");
+      exit(1);
+    }
+    close(p[0]);
+    close(p[1]);
+  }
+  printf("%d pipe/close: %d ticks\n", n, uptime() - t);
+
+  fd = open("fdbench.tmp", O_RDONLY);
+  t = uptime();
+  for(i = 0; i < n / NHOLD + 1; i++){
+    for(j = 0; j < NHOLD; j++){
+      if((fds[j] = dup(fd)) < 0){
+        printf("fdbench: dup failed with %d open\n", j);
+        exit(1);
+      }
+    }
+    for(j = 0; j < NHOLD; j++)
+      close(fds[j]);
+  }
+  printf("%d x %d dup/close: %d ticks\n", n / NHOLD + 1, NHOLD, uptime() - t);
+  close(fd);
+
+  unlink("fdbench.tmp");
+  exit(0);
+}
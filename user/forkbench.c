@@ -0,0 +1,76 @@
+// Measure process turnover: fork() a child that exits at once
+// and wait() for it, N times, first alone and then with other
+// processes sitting in the table, and time kill() of pids that
+// don't exist.
+//
+// usage: forkbench [n]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define NIDLE (NPROC/2)
+
+int idle[NIDLE];
+
+static int
+turnover(int n)
+{
+  int i, pid, t;
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    if(wait(0) != pid){
+      printf("forkbench: wait got the wrong child\n");
+      exit(1);
+    }
+  }
+  return uptime() - t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, p[2], t;
+  char c;
+
+  n = argc > 1 ? atoi(argv[1]) : 1000;
+
+  printf("%d fork/exit/wait: %d ticks\n", n, turnover(n));
+
+  // children that wait on a pipe until the end.
+  if(pipe(p) < 0){
+    printf("forkbench: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NIDLE; i++){
+    if((idle[i] = fork()) < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(idle[i] == 0){
+      close(p[1]);
+      read(p[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(p[0]);
+  printf("%d fork/exit/wait with %d more children: %d ticks\n", n, NIDLE, turnover(n));
+
+  t = uptime();
+  for(i = 0; i < n; i++)
+    kill(1000000 + i);
+  printf("%d kill of missing pids: %d ticks\n", n, uptime() - t);
+
+  close(p[1]);
+  for(i = 0; i < NIDLE; i++)
+    wait(0);
+  exit(0);
+}
@@ -30,14 +30,9 @@ main(void)
 
   for(;;){
     printf("init: starting sh\n");
-    pid = fork();
+    pid = spawn("sh", argv, 0, 0);   // sh.c中从main开始执行
     if(pid < 0){
-      printf("init: fork failed\n");
-      exit(1);
-    }
-    if(pid == 0){
-      exec("sh", argv);   // sh.c中从main开始执行
-      printf("init: exec sh failed\n");
+      printf("init: spawn sh failed\n");
       exit(1);
     }
 
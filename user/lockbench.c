@@ -0,0 +1,55 @@
+// Contend for sleep-locks: n processes read the same small file
+// over and over, so they share its inode lock and take turns on
+// the buffer locks of its blocks, and report the ticks it took
+// and how the sleep-lock acquires went: at once, after spinning
+// while the holder ran on another CPU, or after sleeping.
+//
+// usage: lockbench [nproc]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NREAD 500
+
+char buf[1024];
+
+int
+main(int argc, char *argv[])
+{
+  struct sleepstat st0, st1;
+  int i, j, n, fd, t;
+
+  n = argc > 1 ? atoi(argv[1]) : 4;
+
+  if((fd = open("lockbench.tmp", O_CREATE|O_RDWR)) < 0 ||
+     write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("lockbench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  sleepstat(&st0);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      if((fd = open("lockbench.tmp", O_RDONLY)) < 0)
+        exit(1);
+      for(j = 0; j < NREAD; j++)
+        pread(fd, buf, sizeof(buf), 0);
+      exit(0);
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait(0);
+  t = uptime() - t;
+  sleepstat(&st1);
+
+  printf("%d procs x %d reads: %d ticks\n", n, NREAD, t);
+  printf("exclusive %d, shared %d, spun %d, slept %d\n",
+         (int)(st1.acquire - st0.acquire), (int)(st1.shared - st0.shared),
+         (int)(st1.spin - st0.spin), (int)(st1.sleep - st0.sleep));
+  unlink("lockbench.tmp");
+  exit(0);
+}
@@ -2,6 +2,18 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/ring.h"
+
+// A directory's entries are read a block's worth at a time and
+// stat()ed NBATCH at a time, with one ringenter() call doing the
+// open, fstat and close for every entry in the batch.
+#define NBATCH  (RINGSIZE/3)
+
+struct ring *ring;
+char names[NBATCH][512];
+struct stat sts[NBATCH];
+int ok[NBATCH];
 
 char*
 fmtname(char *path)
@@ -22,12 +34,66 @@ fmtname(char *path)
   return buf;
 }
 
+// Stat names[0..n-1] into sts[], setting ok[i] if names[i] worked.
+void
+statbatch(int n)
+{
+  struct ringsqe *sqe;
+  struct ringcqe *cqe;
+  int i;
+
+  if(ring == 0){
+    for(i = 0; i < n; i++)
+      ok[i] = stat(names[i], &sts[i]) >= 0;
+    return;
+  }
+  for(i = 0; i < n; i++){
+    ok[i] = 0;
+    sqe = &ring->sq[ring->sqtail++ % RINGSIZE];
+    sqe->op = RING_OPEN;
+    sqe->addr = (uint64)names[i];
+    sqe->n = O_RDONLY;
+    sqe->data = -1;
+    sqe = &ring->sq[ring->sqtail++ % RINGSIZE];
+    sqe->op = RING_FSTAT;
+    sqe->fd = RING_PREV;
+    sqe->addr = (uint64)&sts[i];
+    sqe->data = i;
+    sqe = &ring->sq[ring->sqtail++ % RINGSIZE];
+    sqe->op = RING_CLOSE;
+    sqe->fd = RING_PREV;
+    sqe->data = -1;
+  }
+  ringenter(3*n);
+  for(; ring->cqhead != ring->cqtail; ring->cqhead++){
+    cqe = &ring->cq[ring->cqhead % RINGSIZE];
+    if(cqe->data != -1)
+      ok[cqe->data] = cqe->res >= 0;
+  }
+}
+
+void
+printbatch(int n)
+{
+  int i;
+
+  if(n == 0)
+    return;
+  statbatch(n);
+  for(i = 0; i < n; i++){
+    if(!ok[i])
+      printf("ls: cannot stat %s\n", names[i]);
+    else
+      printf("%s %d %d %d\n", fmtname(names[i]), sts[i].type, sts[i].ino, sts[i].size);
+  }
+}
+
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  char *p;
+  int fd, i, n, nde;
+  struct dirent de[BSIZE/sizeof(struct dirent)];
   struct stat st;
 
   if((fd = open(path, 0)) < 0){
@@ -47,24 +113,27 @@ ls(char *path)
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
+    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof names[0]){
       printf("ls: path too long\n");
       break;
     }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
+    n = 0;
+    while((nde = read(fd, de, sizeof(de)) / sizeof(de[0])) > 0){
+      for(i = 0; i < nde; i++){
+        if(de[i].inum == 0)
+          continue;
+        strcpy(names[n], path);
+        p = names[n]+strlen(names[n]);
+        *p++ = '/';
+        memmove(p, de[i].name, DIRSIZ);
+        p[DIRSIZ] = 0;
+        if(++n == NBATCH){
+          printbatch(n);
+          n = 0;
+        }
       }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
+    printbatch(n);
     break;
   }
   close(fd);
@@ -75,6 +144,9 @@ main(int argc, char *argv[])
 {
   int i;
 
+  ring = ringsetup();
+  if((uint64)ring == -1)
+    ring = 0;
   if(argc < 2){
     ls(".");
     exit(0);
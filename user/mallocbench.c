@@ -0,0 +1,65 @@
+// Measure malloc() and free() under a churn of live blocks:
+// keep N blocks alive, and for ROUNDS rounds replace a random one
+// with a new block of random size, first with small sizes only
+// and then with a mix that includes large ones. Reports the ticks
+// each run takes and what the allocator took from the kernel.
+//
+// usage: mallocbench
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define N      1000
+#define ROUNDS 200000
+
+static void *live[N];
+static uint seed = 1;
+
+static uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Churn with sizes from 1 to max bytes. Returns ticks taken.
+static int
+churn(uint max)
+{
+  int i, j, t0;
+
+  t0 = uptime();
+  for(i = 0; i < N; i++)
+    live[i] = malloc(1 + rnd() % max);
+  for(i = 0; i < ROUNDS; i++){
+    j = rnd() % N;
+    free(live[j]);
+    if((live[j] = malloc(1 + rnd() % max)) == 0){
+      printf("mallocbench: out of memory\n");
+      exit(1);
+    }
+    *(char*)live[j] = i;
+  }
+  for(i = 0; i < N; i++){
+    free(live[i]);
+    live[i] = 0;
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct mallocstat st;
+  int t;
+
+  t = churn(128);
+  mallocstat(&st);
+  printf("small (1-128 bytes): %d ticks, heap %d KB\n", t, st.heap / 1024);
+  t = churn(8192);
+  mallocstat(&st);
+  printf("mixed (1-8192 bytes): %d ticks, heap %d KB, %d mallocs, %d frees\n",
+         t, st.heap / 1024, st.nmalloc, st.nfree);
+  exit(0);
+}
@@ -0,0 +1,80 @@
+// Measure pipe throughput: a child writes TOTAL bytes into a
+// pipe in writes of a given size, and the parent reads them.
+// The last runs use vmsplice() to move whole pages instead.
+//
+// usage: pipebench [ring-size]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define TOTAL (4*1024*1024)
+#define BUFSZ 16384
+
+char *buf;  // page-aligned, for vmsplice()
+
+int
+run(int ringsize, int chunk, int splice)
+{
+  int fds[2], pid, n, total, t0, t1;
+
+  if(pipe(fds) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(ringsize > 0 && pipesize(fds[1], ringsize) < 0){
+    printf("pipebench: pipesize %d failed\n", ringsize);
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(total = 0; total < TOTAL; total += chunk){
+      n = splice ? vmsplice(fds[1], buf, chunk) : write(fds[1], buf, chunk);
+      if(n != chunk){
+        printf("pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = splice ? vmsplice(fds[0], buf, chunk) : read(fds[0], buf, chunk)) > 0)
+    total += n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+  if(total != TOTAL){
+    printf("pipebench: read %d bytes, expected %d\n", total, TOTAL);
+    exit(1);
+  }
+  return t1 - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ringsize, chunk, t;
+
+  ringsize = 0;
+  if(argc > 1)
+    ringsize = atoi(argv[1]);
+  buf = sbrk(BUFSZ + 4096);
+  buf += 4096 - (uint64)buf % 4096;
+  memset(buf, 'x', BUFSZ);
+  for(chunk = 64; chunk <= BUFSZ; chunk *= 4){
+    t = run(ringsize, chunk, 0);
+    printf("pipebench: %d bytes in %d-byte writes: %d ticks\n", TOTAL, chunk, t);
+  }
+  for(chunk = 4096; chunk <= BUFSZ; chunk *= 4){
+    t = run(ringsize, chunk, 1);
+    printf("pipebench: %d bytes in %d-byte vmsplices: %d ticks\n", TOTAL, chunk, t);
+  }
+  exit(0);
+}
@@ -0,0 +1,78 @@
+// Measure the handoff latency between two processes: bounce a
+// token back and forth N times, first as one byte through a pair
+// of pipes and then as a post on a pair of named semaphores, and
+// report the ticks each takes.
+//
+// usage: sembench
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define N 10000
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, ping[2], pong[2], sping, spong, t0, t1, t2;
+  char c;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("sembench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if((pid = fork()) < 0){
+    printf("sembench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  c = 'x';
+  for(i = 0; i < N; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("sembench: pipe handoff failed\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  t1 = uptime();
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+
+  if((sping = semopen("sembench.ping", 0)) < 0 ||
+     (spong = semopen("sembench.pong", 0)) < 0){
+    printf("sembench: semopen failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("sembench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(semwait(sping) < 0 || sempost(spong) < 0)
+        exit(1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < N; i++){
+    if(sempost(sping) < 0 || semwait(spong) < 0){
+      printf("sembench: semaphore handoff failed\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  t2 = uptime();
+
+  printf("%d round trips: pipe %d ticks, semaphore %d ticks\n",
+         N, t1 - t0, t2 - t1);
+  exit(0);
+}
@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,12 +53,18 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int spawncmd(struct cmd*, struct spawnact*, int);
+void pipeacts(struct spawnact*, int, int*);
+int gettoken(char**, char*, char**, char**);
+int simplecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
   int p[2];
+  struct spawnact act[SPAWN_MAXACT];
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -91,7 +98,7 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
+    if(spawncmd(lcmd->left, act, 0) == 0 && fork1() == 0)
       runcmd(lcmd->left);
     wait(0);
     runcmd(lcmd->right);
@@ -101,14 +108,16 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    pipeacts(act, 1, p);
+    if(spawncmd(pcmd->left, act, 3) == 0 && fork1() == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    pipeacts(act, 0, p);
+    if(spawncmd(pcmd->right, act, 3) == 0 && fork1() == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
@@ -123,7 +132,7 @@ runcmd(struct cmd *cmd)
 
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
+    if(spawncmd(bcmd->cmd, act, 0) == 0 && fork1() == 0)
       runcmd(bcmd->cmd);
     break;
   }
@@ -146,7 +155,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  struct spawnact act[SPAWN_MAXACT];
+  struct cmd *cmd;
+  int fd, pid;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -165,6 +176,16 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(simplecmd(buf)){
+      // just one program: spawn it from here instead of
+      // copying the shell with fork() only for it to exec().
+      cmd = parsecmd(buf);
+      pid = spawncmd(cmd, act, 0);
+      freecmd(cmd);
+      if(pid > 0)
+        wait(0);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -190,6 +211,91 @@ fork1(void)
   return pid;
 }
 
+// Is the line s just one program with redirections, which the
+// shell can parse itself without parsecmd() failing?
+int
+simplecmd(char *s)
+{
+  char *es;
+  int tok, argc, nredir;
+
+  es = s + strlen(s);
+  argc = nredir = 0;
+  while((tok = gettoken(&s, es, 0, 0)) != 0){
+    switch(tok){
+    case 'a':
+      if(++argc >= MAXARGS)
+        return 0;
+      break;
+    case '<':
+    case '>':
+    case '+':
+      if(++nredir > SPAWN_MAXACT || gettoken(&s, es, 0, 0) != 'a')
+        return 0;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return argc > 0;
+}
+
+// Free a command that simplecmd() let the shell parse.
+void
+freecmd(struct cmd *cmd)
+{
+  struct cmd *next;
+
+  for(; cmd; cmd = next){
+    next = cmd->type == REDIR ? ((struct redircmd*)cmd)->cmd : 0;
+    free(cmd);
+  }
+}
+
+// Start cmd with spawn() if it is one program with redirections,
+// after the file actions act[0..nact), which has room for
+// SPAWN_MAXACT. Returns its pid, -1 if spawn() failed, or 0 if
+// cmd is not that simple and needs fork1() and runcmd().
+int
+spawncmd(struct cmd *cmd, struct spawnact *act, int nact)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int pid;
+
+  for(; cmd && cmd->type == REDIR; cmd = rcmd->cmd){
+    rcmd = (struct redircmd*)cmd;
+    if(nact == SPAWN_MAXACT)
+      return 0;
+    act[nact].op = SPAWN_OPEN;
+    act[nact].fd = rcmd->fd;
+    act[nact].omode = rcmd->mode;
+    act[nact].path = rcmd->file;
+    nact++;
+  }
+  if(cmd == 0 || cmd->type != EXEC)
+    return 0;
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0)
+    return 0;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, act, nact)) < 0)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+  return pid;
+}
+
+// Fill in act[0..3) to connect fd 0 or 1 to its end of pipe p.
+void
+pipeacts(struct spawnact *act, int fd, int *p)
+{
+  act[0].op = SPAWN_DUP;
+  act[0].fd = fd;
+  act[0].srcfd = p[fd];
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = p[0];
+  act[2].op = SPAWN_CLOSE;
+  act[2].fd = p[1];
+}
+
 //PAGEBREAK!
 // Constructors
 
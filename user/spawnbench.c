@@ -0,0 +1,75 @@
+// Measure how long it takes to start a program and wait for it,
+// with fork() or vfork() then exec() in the child, and with
+// spawn(). fork() copies the caller's memory first, so the gap
+// grows with the size of the caller, which can be given in KB.
+//
+// usage: spawnbench [heap-kb]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define N 200
+
+char *args[] = { "spawnbench", "-x", 0 };
+
+int
+main(int argc, char *argv[])
+{
+  int i, kb, pid, t0, t1, t2, t3;
+  char *heap;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);  // the program being started
+
+  kb = argc > 1 ? atoi(argv[1]) : 0;
+  if(kb > 0){
+    if((heap = sbrk(kb*1024)) == (char*)-1){
+      printf("spawnbench: sbrk failed\n");
+      exit(1);
+    }
+    memset(heap, 1, kb*1024);
+  }
+
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("spawnbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(args[0], args);
+      printf("spawnbench: exec failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  t1 = uptime();
+  for(i = 0; i < N; i++){
+    if(spawn(args[0], args, 0, 0) < 0){
+      printf("spawnbench: spawn failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  t2 = uptime();
+  for(i = 0; i < N; i++){
+    pid = vfork();
+    if(pid < 0){
+      printf("spawnbench: vfork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(args[0], args);
+      printf("spawnbench: exec failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  t3 = uptime();
+
+  printf("%d programs, %d KB heap: fork+exec %d ticks, spawn %d ticks, vfork+exec %d ticks\n",
+         N, kb, t1 - t0, t2 - t1, t3 - t2);
+  exit(0);
+}
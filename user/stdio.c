@@ -0,0 +1,318 @@
+// Buffered I/O on top of read() and write().
+//
+// Output to the console is line buffered, and output to anything
+// else is written when the buffer fills or at fflush() or fclose().
+// stderr is flushed at the end of every call that writes to it.
+// fork(), exec() and exit() in ulib.c flush all output first, so a
+// child does not repeat its parent's pending output and a process
+// does not lose its own. Reading stdin flushes stdout, so a prompt
+// appears before the program waits for input. stdin is read a byte
+// at a time unless it is the console, so that after sh < script
+// reads a line the rest is left for the commands it runs.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define BUFSIZ 512
+
+#define F_READ   0x01
+#define F_WRITE  0x02
+#define F_LINE   0x04  // flush output at a newline
+#define F_NOBUF  0x08  // flush output at the end of each call, or
+                       // don't read input ahead
+#define F_SETUP  0x10  // buffering mode has been chosen
+#define F_EOF    0x20
+#define F_ERR    0x40
+
+struct FILE {
+  FILE *next;     // list of open FILEs, for fflush(0)
+  int fd;
+  int flags;
+  int n;          // bytes in buf: pending output, or input read so far
+  int pos;        // next input byte in buf
+  char buf[BUFSIZ];
+};
+
+static FILE stderrf = { 0, 2, F_WRITE|F_NOBUF|F_SETUP };
+static FILE stdoutf = { &stderrf, 1, F_WRITE };
+static FILE stdinf = { &stdoutf, 0, F_READ };
+static FILE *files = &stdinf;
+
+FILE *stdin = &stdinf;
+FILE *stdout = &stdoutf;
+FILE *stderr = &stderrf;
+
+extern void (*_flushhook)(void);
+
+static void
+flushall(void)
+{
+  fflush(0);
+}
+
+// Pick the buffering mode for f on its first use.
+static void
+setup(FILE *f)
+{
+  struct stat st;
+
+  if(f->flags & F_SETUP)
+    return;
+  f->flags |= F_SETUP;
+  if(fstat(f->fd, &st) == 0 && st.type == T_DEVICE)
+    f->flags |= F_LINE;
+  else if(f == stdin)
+    f->flags |= F_NOBUF;
+  if(f->flags & F_WRITE)
+    _flushhook = flushall;
+}
+
+static int
+flush(FILE *f)
+{
+  int i, n;
+
+  for(i = 0; i < f->n; i += n){
+    if((n = write(f->fd, f->buf + i, f->n - i)) <= 0){
+      f->flags |= F_ERR;
+      f->n = 0;
+      return -1;
+    }
+  }
+  f->n = 0;
+  return 0;
+}
+
+// Write out f's pending output, or that of every open FILE if f is 0.
+int
+fflush(FILE *f)
+{
+  int r;
+
+  if(f == 0){
+    r = 0;
+    for(f = files; f; f = f->next)
+      if(fflush(f) < 0)
+        r = -1;
+    return r;
+  }
+  if((f->flags & F_WRITE) && f->n > 0)
+    return flush(f);
+  return 0;
+}
+
+FILE*
+fdopen(int fd, const char *mode)
+{
+  FILE *f;
+
+  if((f = malloc(sizeof(*f))) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->fd = fd;
+  if(mode[0] == 'r')
+    f->flags = F_READ;
+  else if(mode[0] == 'w')
+    f->flags = F_WRITE;
+  else {
+    free(f);
+    return 0;
+  }
+  f->next = files;
+  files = f;
+  return f;
+}
+
+// mode is "r" to read or "w" to create or truncate and write.
+FILE*
+fopen(const char *path, const char *mode)
+{
+  FILE *f;
+  int fd;
+
+  if(mode[0] == 'r')
+    fd = open(path, O_RDONLY);
+  else if(mode[0] == 'w')
+    fd = open(path, O_CREATE|O_TRUNC|O_WRONLY);
+  else
+    return 0;
+  if(fd < 0)
+    return 0;
+  if((f = fdopen(fd, mode)) == 0)
+    close(fd);
+  return f;
+}
+
+int
+fclose(FILE *f)
+{
+  FILE **pp;
+  int r;
+
+  r = fflush(f);
+  if(close(f->fd) < 0)
+    r = -1;
+  for(pp = &files; *pp; pp = &(*pp)->next){
+    if(*pp == f){
+      *pp = f->next;
+      break;
+    }
+  }
+  if(f != stdin && f != stdout && f != stderr)
+    free(f);
+  return r;
+}
+
+int
+fwrite(const void *p, uint size, uint nmemb, FILE *f)
+{
+  const char *s = p;
+  uint i, j, n, m;
+  int r, nl;
+
+  if((f->flags & F_WRITE) == 0)
+    return 0;
+  setup(f);
+  n = size * nmemb;
+  nl = 0;
+  for(i = 0; i < n; i += m){
+    if(f->n == 0 && n - i >= BUFSIZ){
+      // too big to be worth buffering.
+      if((r = write(f->fd, s + i, n - i)) <= 0){
+        f->flags |= F_ERR;
+        return i / size;
+      }
+      m = r;
+      continue;
+    }
+    m = BUFSIZ - f->n;
+    if(m > n - i)
+      m = n - i;
+    memmove(f->buf + f->n, s + i, m);
+    f->n += m;
+    if(f->flags & F_LINE)
+      for(j = i; j < i + m; j++)
+        if(s[j] == '\n')
+          nl = 1;
+    if(f->n == BUFSIZ && flush(f) < 0)
+      return (i + m) / size;
+  }
+  if((nl || (f->flags & F_NOBUF)) && fflush(f) < 0)
+    return 0;
+  return nmemb;
+}
+
+int
+fputc(int c, FILE *f)
+{
+  if((f->flags & F_WRITE) == 0)
+    return -1;
+  setup(f);
+  f->buf[f->n++] = c;
+  if(f->n == BUFSIZ || (f->flags & F_NOBUF) || (c == '\n' && (f->flags & F_LINE)))
+    if(flush(f) < 0)
+      return -1;
+  return (uchar)c;
+}
+
+static int
+fill(FILE *f)
+{
+  int n;
+
+  setup(f);
+  if(f == stdin)
+    fflush(stdout);
+  if((n = read(f->fd, f->buf, (f->flags & F_NOBUF) ? 1 : BUFSIZ)) <= 0){
+    f->flags |= n == 0 ? F_EOF : F_ERR;
+    return -1;
+  }
+  f->n = n;
+  f->pos = 0;
+  return 0;
+}
+
+int
+fread(void *p, uint size, uint nmemb, FILE *f)
+{
+  char *s = p;
+  uint i, n, m;
+  int r;
+
+  if((f->flags & F_READ) == 0)
+    return 0;
+  n = size * nmemb;
+  for(i = 0; i < n; i += m){
+    if(f->pos == f->n){
+      if(n - i >= BUFSIZ){
+        // read straight into the caller's buffer.
+        if(f == stdin)
+          fflush(stdout);
+        if((r = read(f->fd, s + i, n - i)) <= 0){
+          f->flags |= r == 0 ? F_EOF : F_ERR;
+          break;
+        }
+        m = r;
+        continue;
+      }
+      if(fill(f) < 0)
+        break;
+    }
+    m = f->n - f->pos;
+    if(m > n - i)
+      m = n - i;
+    memmove(s + i, f->buf + f->pos, m);
+    f->pos += m;
+  }
+  return i / size;
+}
+
+int
+fgetc(FILE *f)
+{
+  if((f->flags & F_READ) == 0)
+    return -1;
+  if(f->pos == f->n && fill(f) < 0)
+    return -1;
+  return (uchar)f->buf[f->pos++];
+}
+
+// Read a line of at most max-1 bytes, keeping the newline.
+// Returns 0 if there was nothing left to read.
+char*
+fgets(char *buf, int max, FILE *f)
+{
+  int i, c;
+
+  for(i = 0; i+1 < max; ){
+    if((c = fgetc(f)) < 0)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+char*
+gets(char *buf, int max)
+{
+  if(fgets(buf, max, stdin) == 0)
+    buf[0] = '\0';
+  return buf;
+}
+
+int
+feof(FILE *f)
+{
+  return (f->flags & F_EOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+  return (f->flags & F_ERR) != 0;
+}
@@ -13,12 +13,13 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 
+char data[2048];
+
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, t0, t1, t2;
   char path[] = "stressfs0";
-  char data[512];
 
   printf("stressfs starting\n");
   memset(data, 'a', sizeof(data));
@@ -30,11 +31,13 @@ main(int argc, char *argv[])
   printf("write %d\n", i);
 
   path[8] += i;
+  t0 = uptime();
   fd = open(path, O_CREATE | O_RDWR);
   for(i = 0; i < 20; i++)
 //    printf(fd, "%d\n", i);
     write(fd, data, sizeof(data));
   close(fd);
+  t1 = uptime();
 
   printf("read\n");
 
@@ -42,6 +45,11 @@ main(int argc, char *argv[])
   for (i = 0; i < 20; i++)
     read(fd, data, sizeof(data));
   close(fd);
+  t2 = uptime();
+  unlink(path);
+
+  printf("%s: wrote %d bytes in %d ticks, read in %d ticks\n",
+         path, 20 * (int)sizeof(data), t1 - t0, t2 - t1);
 
   wait(0);
 
@@ -0,0 +1,112 @@
+// Threads and mutexes on top of clone() and futex().
+//
+// A thread runs on a stack from malloc() and shares everything
+// else with the rest of the process. When it returns, the kernel
+// clears its tid word and wakes any thread_join() waiting on it;
+// only then is it safe to free the stack.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+
+#define STACKSIZE (4*4096)
+
+static struct thr {
+  int id;             // tid, or 0 if the slot is free
+  int live;           // tid until the thread exits, then 0
+  char *stack;
+  void (*fn)(void*);
+  void *arg;
+} threads[NTHREAD];
+
+static struct mutex tlock;  // protects threads[]
+
+static void
+start(void *arg)
+{
+  struct thr *t = arg;
+
+  t->fn(t->arg);
+  _exit(0);  // not exit(), which would end the whole process
+}
+
+// Start a thread running fn(arg). Returns its tid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct thr *t;
+  int tid;
+
+  mutex_lock(&tlock);
+  for(t = threads; t < &threads[NTHREAD]; t++)
+    if(t->id == 0)
+      break;
+  if(t == &threads[NTHREAD] || (t->stack = malloc(STACKSIZE)) == 0){
+    mutex_unlock(&tlock);
+    return -1;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  // the kernel stores the tid in t->live before the thread runs.
+  if((tid = clone(start, t, t->stack + STACKSIZE, &t->live)) < 0){
+    free(t->stack);
+    mutex_unlock(&tlock);
+    return -1;
+  }
+  t->id = tid;
+  mutex_unlock(&tlock);
+  return tid;
+}
+
+// Wait for thread tid to return, and free its stack.
+int
+thread_join(int tid)
+{
+  struct thr *t;
+  int v;
+
+  mutex_lock(&tlock);
+  for(t = threads; t < &threads[NTHREAD]; t++)
+    if(t->id == tid)
+      break;
+  mutex_unlock(&tlock);
+  if(tid <= 0 || t == &threads[NTHREAD])
+    return -1;
+
+  while((v = __atomic_load_n(&t->live, __ATOMIC_SEQ_CST)) != 0)
+    futex(&t->live, FUTEX_WAIT, v);
+
+  mutex_lock(&tlock);
+  free(t->stack);
+  t->id = 0;
+  mutex_unlock(&tlock);
+  return 0;
+}
+
+// m->state is 0 if unlocked, 1 if locked, and 2 if locked
+// and there may be threads sleeping in futex() for it, which
+// lets mutex_unlock() skip the system call in the common case.
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_SEQ_CST);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
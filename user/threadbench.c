@@ -0,0 +1,102 @@
+// Measure how a compute-bound job scales with threads: count
+// the primes below LIMIT with 1, 2, 4 ... threads up to the
+// given maximum, each thread taking every nth number, and
+// report the ticks each run takes. Then time a counter bumped
+// under one mutex by all the threads, to show the cost of
+// contention.
+//
+// usage: threadbench [max-threads]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define LIMIT 200000
+#define NINC  20000
+
+struct job {
+  int first;
+  int step;
+  int count;
+};
+
+static struct job jobs[NTHREAD];
+static struct mutex lock;
+static int counter;
+
+static void
+primes(void *arg)
+{
+  struct job *j = arg;
+  int n, d;
+
+  j->count = 0;
+  for(n = j->first; n < LIMIT; n += j->step){
+    if(n < 2)
+      continue;
+    for(d = 2; d*d <= n; d++)
+      if(n % d == 0)
+        break;
+    if(d*d > n)
+      j->count++;
+  }
+}
+
+static void
+inc(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NINC; i++){
+    mutex_lock(&lock);
+    counter++;
+    mutex_unlock(&lock);
+  }
+}
+
+// Run fn(&jobs[i]) in n threads, the first in the caller's,
+// and return the ticks it took.
+static int
+run(void (*fn)(void*), int n)
+{
+  int i, t0, tid[NTHREAD];
+
+  t0 = uptime();
+  for(i = 1; i < n; i++){
+    if((tid[i] = thread_create(fn, &jobs[i])) < 0){
+      printf("threadbench: thread_create failed\n");
+      exit(1);
+    }
+  }
+  fn(&jobs[0]);
+  for(i = 1; i < n; i++)
+    thread_join(tid[i]);
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, max, total, t;
+
+  max = argc > 1 ? atoi(argv[1]) : 4;
+  if(max < 1 || max >= NTHREAD)
+    max = NTHREAD - 1;
+
+  for(n = 1; n <= max; n *= 2){
+    for(i = 0; i < n; i++){
+      jobs[i].first = i;
+      jobs[i].step = n;
+    }
+    t = run(primes, n);
+    total = 0;
+    for(i = 0; i < n; i++)
+      total += jobs[i].count;
+    printf("%d threads: %d primes below %d in %d ticks\n", n, total, LIMIT, t);
+  }
+
+  counter = 0;
+  t = run(inc, max);
+  printf("%d threads: %d locked increments in %d ticks\n", max, counter, t);
+  exit(0);
+}
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/param.h"
 #include "user/user.h"
 
 char*
@@ -52,24 +53,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -134,3 +117,193 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Set by stdio.c once there may be buffered output, which must be
+// written before the process forks, execs, spawns or exits.
+void (*_flushhook)(void);
+
+int
+fork(void)
+{
+  if(_flushhook)
+    _flushhook();
+  return _fork();
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(_flushhook)
+    _flushhook();
+  return _exec(path, argv);
+}
+
+int
+spawn(char *path, char **argv, struct spawnact *act, int nact)
+{
+  if(_flushhook)
+    _flushhook();
+  return _spawn(path, argv, act, nact);
+}
+
+int
+exit(int status)
+{
+  if(_flushhook)
+    _flushhook();
+  _exit(status);
+}
+
+// The semaphore called name with suffix c, for the helpers below.
+static int
+semsuffix(char *name, char c, int value)
+{
+  char buf[SEMNAME];
+  int i;
+
+  for(i = 0; name[i] && i < SEMNAME-3; i++)
+    buf[i] = name[i];
+  buf[i++] = '.';
+  buf[i++] = c;
+  buf[i] = 0;
+  return semopen(buf, value);
+}
+
+// A barrier for n processes, numbered 0 to n-1, that fork()
+// after barrier_init(). The others post arrive and wait on their
+// own depart semaphore; process 0 collects the n-1 arrivals and
+// then releases each one. A semaphore per process, rather than
+// one for all, keeps a process that races ahead into the next
+// round from taking a token meant for a slower one.
+int
+barrier_init(struct barrier *b, char *name, int n)
+{
+  int i;
+
+  if(n < 1 || n > sizeof(b->depart)/sizeof(b->depart[0]))
+    return -1;
+  b->n = n;
+  if((b->arrive = semsuffix(name, 'a', 0)) < 0)
+    return -1;
+  for(i = 1; i < n; i++){
+    if((b->depart[i] = semsuffix(name, '0' + i, 0)) < 0){
+      b->n = i;
+      barrier_close(b);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Wait until all n processes have called barrier_wait().
+int
+barrier_wait(struct barrier *b, int me)
+{
+  int i;
+
+  if(me != 0){
+    if(sempost(b->arrive) < 0)
+      return -1;
+    return semwait(b->depart[me]);
+  }
+  for(i = 1; i < b->n; i++)
+    if(semwait(b->arrive) < 0)
+      return -1;
+  for(i = 1; i < b->n; i++)
+    sempost(b->depart[i]);
+  return 0;
+}
+
+void
+barrier_close(struct barrier *b)
+{
+  int i;
+
+  close(b->arrive);
+  for(i = 1; i < b->n; i++)
+    close(b->depart[i]);
+}
+
+// A bounded queue of ints shared by processes that fork() after
+// workq_init(). The slots, and the head and tail counts, live in
+// a file; semaphores count the full and empty slots, and one more
+// serves as a mutex for the counts.
+
+#define WQSLOTS 64
+
+int
+workq_init(struct workq *q, char *name)
+{
+  int hdr[2] = { 0, 0 };
+
+  if((q->fd = open(name, O_CREATE|O_TRUNC|O_RDWR)) < 0)
+    return -1;
+  if(pwrite(q->fd, hdr, sizeof(hdr), 0) != sizeof(hdr))
+    goto bad;
+  if((q->items = semsuffix(name, 'i', 0)) < 0)
+    goto bad;
+  if((q->space = semsuffix(name, 's', WQSLOTS)) < 0)
+    goto bad1;
+  if((q->lock = semsuffix(name, 'l', 1)) < 0)
+    goto bad2;
+  return 0;
+
+ bad2:
+  close(q->space);
+ bad1:
+  close(q->items);
+ bad:
+  close(q->fd);
+  return -1;
+}
+
+// Add x at the tail, waiting while the queue is full.
+int
+workq_put(struct workq *q, int x)
+{
+  int tail, r;
+
+  if(semwait(q->space) < 0 || semwait(q->lock) < 0)
+    return -1;
+  r = -1;
+  if(pread(q->fd, &tail, sizeof(tail), sizeof(int)) == sizeof(tail) &&
+     pwrite(q->fd, &x, sizeof(x), (2 + tail % WQSLOTS) * sizeof(int)) == sizeof(x)){
+    tail++;
+    if(pwrite(q->fd, &tail, sizeof(tail), sizeof(int)) == sizeof(tail))
+      r = 0;
+  }
+  sempost(q->lock);
+  if(r == 0)
+    sempost(q->items);
+  return r;
+}
+
+// Take the int at the head into *x, waiting while the queue is empty.
+int
+workq_get(struct workq *q, int *x)
+{
+  int head, r;
+
+  if(semwait(q->items) < 0 || semwait(q->lock) < 0)
+    return -1;
+  r = -1;
+  if(pread(q->fd, &head, sizeof(head), 0) == sizeof(head) &&
+     pread(q->fd, x, sizeof(*x), (2 + head % WQSLOTS) * sizeof(int)) == sizeof(*x)){
+    head++;
+    if(pwrite(q->fd, &head, sizeof(head), 0) == sizeof(head))
+      r = 0;
+  }
+  sempost(q->lock);
+  if(r == 0)
+    sempost(q->space);
+  return r;
+}
+
+void
+workq_close(struct workq *q)
+{
+  close(q->lock);
+  close(q->space);
+  close(q->items);
+  close(q->fd);
+}
@@ -1,103 +1,253 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with size classes.
+//
+// Every block starts with a 16-byte header giving its size and
+// size class. Requests of up to 2048 bytes (header included)
+// are rounded up to one of NBIN classes, and each class keeps
+// its own list of free blocks, so malloc() and free() of small
+// blocks just pop and push that list. An empty class is refilled
+// by carving a slab from the top of the heap into blocks of its
+// size. Blocks are never split or merged across classes.
+//
+// Larger requests take the best fit from a list of free large
+// blocks, kept in address order as in the Kernighan and Ritchie
+// allocator (The C Programming Language, 2nd ed. Section 8.7) so
+// that free() can merge neighbours, or else come from the top.
+// The top of the heap grows with sbrk() in whole pages, as needed.
+//
+// Memory goes back to the kernel from large blocks only. A free
+// large block at the top of the heap rejoins the top, which
+// shrinks with a negative sbrk() once TRIM bytes are unused, and
+// the whole pages inside a free large block of at least HOLE bytes
+// are dropped with madvise(), to come back as zero pages on reuse.
 
-// 当有申请请求时，malloc 将扫描空闲块链表，直到找到一个足够大的块为止。该算法称
-// 为“首次适应”（first fit）；与之相对的算法是“最佳适应”（best fit），它寻找满足条件的最小
-// 块。如果该块恰好与请求的大小相符合，则将它从链表中移走并返回给用户。如果该块太大，
-// 则将它分成两部分：大小合适的块返回给用户，剩下的部分留在空闲块链表中。如果找不到
-// 一个足够大的块，则向操作系统申请一个大块并加入到空闲块链表中
-
-// Block organization: https://s2.loli.net/2022/03/26/EnrZyUxTGpdm1gj.png
-// Header: https://s2.loli.net/2022/03/26/ZWnwgh5ltoafRcq.png
-
-// 空闲块包含一个指向链表中下一个块的指针、一个块大小的记录和
-// 一个指向空闲空间本身的指针(free data start address)
 typedef long Align;   /* for alignment to long boundary */
 
 union header {        /* block header (free or used) */
   struct {
-    union header *ptr;  /* next block if on free list */
-    uint size;          /* size of this block */
+    union header *next; /* next block if on a free list */
+    uint size;          /* bytes in this block, header included */
+    uint bin;           /* size class, or LARGE */
   } s;
-  Align x;              /* force alignment of blocks (never used) */
+  Align x[2];           /* force 16-byte blocks (never used) */
 };
 
 typedef union header Header;
 
-static Header base;   /* 空闲块链表的头部 */
-static Header *freep; /* 上一次找到空闲块的地方 */
+#define NBIN  14
+#define LARGE NBIN
+#define SLAB  4096    /* least bytes to carve into small blocks */
+#define TRIM  (64*1024)   /* unused top of heap to give back */
+#define HOLE  (16*1024)   /* free large block worth dropping pages of */
 
-void
-free(void *ap)
+#define PGUP(a)   (((uint64)(a) + 4095) & ~4095L)
+#define PGDOWN(a) ((uint64)(a) & ~4095L)
+
+static uint binsize[NBIN] = {
+  32, 48, 64, 80, 96, 112, 128, 192, 256, 384, 512, 768, 1024, 2048
+};
+
+static Header *bin[NBIN];     /* free small blocks of each class */
+static Header *large;         /* free large blocks, by address */
+static char *top, *topend;    /* memory from sbrk() not yet handed out */
+static struct mallocstat mstat;
+static struct mutex lock;     /* threads share all of the above */
+
+// Take n bytes, a multiple of 16, from the top of the heap.
+static char*
+morecore(uint n)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  char *brk, *p;
+  uint grow;
+
+  if(topend - top < n){
+    brk = sbrk(0);
+    if(brk != topend){
+      // the program moved the break itself; start again
+      // from there, losing what was left at the old top.
+      top = topend = (char*)(((uint64)brk + 15) & ~15);
+    }
+    grow = (topend - brk) + n - (topend - top);
+    grow = (grow + 4095) & ~4095;
+    if(sbrk(grow) == (char*)-1)
+      return 0;
+    topend = brk + grow;
+    mstat.heap += grow;
+  }
+  p = top;
+  top += n;
+  return p;
 }
 
-static Header*
-morecore(uint nu)
+// Carve a slab into free blocks of class b.
+static int
+refill(int b)
 {
+  uint n, size;
   char *p;
-  Header *hp;
+  Header *h;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  size = binsize[b];
+  n = SLAB < 4*size ? 4*size : SLAB;
+  if((p = morecore(n)) == 0)
+    return -1;
+  for(; n >= size; n -= size, p += size){
+    h = (Header*)p;
+    h->s.size = size;
+    h->s.bin = b;
+    h->s.next = bin[b];
+    bin[b] = h;
+  }
+  return 0;
+}
+
+// Return the best-fitting free large block of at least size
+// bytes, or a new one from the top of the heap.
+static Header*
+largealloc(uint size)
+{
+  Header *h, **hp, **best;
+
+  best = 0;
+  for(hp = &large; (h = *hp) != 0; hp = &h->s.next)
+    if(h->s.size >= size && (best == 0 || h->s.size < (*best)->s.size))
+      best = hp;
+
+  if(best == 0){
+    if((h = (Header*)morecore(size)) == 0)
+      return 0;
+    h->s.size = size;
+    h->s.bin = LARGE;
+    return h;
+  }
+
+  h = *best;
+  if(h->s.size - size > binsize[NBIN-1]){
+    // hand out the tail, leaving the rest on the list.
+    h->s.size -= size;
+    h = (Header*)((char*)h + h->s.size);
+    h->s.size = size;
+    h->s.bin = LARGE;
+  } else
+    *best = h->s.next;
+  return h;
+}
+
+// Give the unused top of the heap back to the kernel, if there
+// is enough of it and the program hasn't moved the break.
+static void
+trim(void)
+{
+  char *end;
+
+  end = (char*)PGUP(top);
+  if(topend - end < TRIM || sbrk(0) != topend)
+    return;
+  if(sbrk(-(topend - end)) == (char*)-1)
+    return;
+  mstat.heap -= topend - end;
+  topend = end;
+}
+
+// Put large block h on the free list, merging it with the
+// blocks on either side if they are free too.
+static void
+largefree(Header *h)
+{
+  Header *prev, **hp;
+  uint64 a, e;
+
+  prev = 0;
+  for(hp = &large; *hp && *hp < h; hp = &(*hp)->s.next)
+    prev = *hp;
+  h->s.next = *hp;
+  *hp = h;
+  if(h->s.next && (char*)h + h->s.size == (char*)h->s.next){
+    h->s.size += h->s.next->s.size;
+    h->s.next = h->s.next->s.next;
+  }
+  if(prev && (char*)prev + prev->s.size == (char*)h){
+    prev->s.size += h->s.size;
+    prev->s.next = h->s.next;
+    h = prev;
+  }
+
+  if((char*)h + h->s.size == top){
+    // the last block before the top: hand it back to the top.
+    for(hp = &large; *hp != h; hp = &(*hp)->s.next)
+      ;
+    *hp = h->s.next;
+    top = (char*)h;
+    trim();
+    return;
+  }
+
+  // keep the header, which holds the list link.
+  a = PGUP(h + 1);
+  e = PGDOWN((char*)h + h->s.size);
+  if(e > a && e - a >= HOLE)
+    madvise((void*)a, e - a, MADV_DONTNEED);
+}
+
+void
+free(void *ap)
+{
+  Header *h;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  mutex_lock(&lock);
+  mstat.nfree++;
+  mstat.inuse -= h->s.size;
+  if(h->s.bin < NBIN){
+    h->s.next = bin[h->s.bin];
+    bin[h->s.bin] = h;
+  } else
+    largefree(h);
+  mutex_unlock(&lock);
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *h;
+  uint size;
+  int b;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){     /* no free list yet */
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  /* 找符合条件的空闲块 */
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){    /* 找到足够大的空闲块 */
-      if(p->s.size == nunits)   /* 大小正好 */
-        prevp->s.ptr = p->s.ptr;
-      else {                    /* If malloc() will use a part of a free segement, this is split into two parts. */
-                                /* The first remains free, the second will be the one returned */
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);    /* 1是头部的大小 */
+  if(nbytes > 0x7fffffff)
+    return 0;
+  size = (nbytes + sizeof(Header) + 15) & ~15;
+  mutex_lock(&lock);
+  if(size <= binsize[NBIN-1]){
+    for(b = 0; binsize[b] < size; b++)
+      ;
+    if(bin[b] == 0 && refill(b) < 0){
+      mutex_unlock(&lock);
+      return 0;
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+    h = bin[b];
+    bin[b] = h->s.next;
+  } else if((h = largealloc(size)) == 0){
+    mutex_unlock(&lock);
+    return 0;
   }
+  mstat.nmalloc++;
+  mstat.inuse += h->s.size;
+  mutex_unlock(&lock);
+  return (void*)(h + 1);
+}
+
+// Report what malloc() has been up to.
+void
+mallocstat(struct mallocstat *st)
+{
+  mutex_lock(&lock);
+  *st = mstat;
+  mutex_unlock(&lock);
 }
@@ -1,9 +1,41 @@
 struct stat;
 struct rtcdate;
+struct dcachestat;
+struct sleepstat;
+struct iovec;
+struct ring;
+struct spawnact;
+typedef struct FILE FILE;
+
+struct mutex {
+  int state;
+};
+
+struct barrier {
+  int n;
+  int arrive;       // semaphore the others post on arriving
+  int depart[8];    // semaphore each but process 0 waits on to leave
+};
+
+struct mallocstat {
+  uint nmalloc;     // successful malloc() calls
+  uint nfree;       // free() calls
+  uint inuse;       // bytes in allocated blocks, headers included
+  uint heap;        // bytes malloc() has taken with sbrk()
+};
+
+struct workq {
+  int fd;           // file holding the head and tail counts and slots
+  int items;        // semaphore counting full slots
+  int space;        // semaphore counting empty slots
+  int lock;         // semaphore guarding head and tail
+};
 
 // system calls
 int fork(void);
+int _fork(void);
 int exit(int) __attribute__((noreturn));
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
@@ -11,6 +43,7 @@ int read(int, void*, int);
 int close(int);
 int kill(int);
 int exec(char*, char**);
+int _exec(char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -23,6 +56,27 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int dcachestat(struct dcachestat*);
+int pipesize(int, int);
+int vmsplice(int, void*, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+struct ring* ringsetup(void);
+int ringenter(int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int spawn(char*, char**, struct spawnact*, int);
+int _spawn(char*, char**, struct spawnact*, int);
+int vfork(void);
+int clone(void (*)(void*), void*, void*, int*);
+int futex(int*, int, int);
+int semopen(const char*, int);
+int semwait(int);
+int sempost(int);
+int madvise(void*, int, int);
+int sleepstat(struct sleepstat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -32,11 +86,39 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
-char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void mallocstat(struct mallocstat*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int barrier_init(struct barrier*, char*, int);
+int barrier_wait(struct barrier*, int);
+void barrier_close(struct barrier*);
+int workq_init(struct workq*, char*);
+int workq_put(struct workq*, int);
+int workq_get(struct workq*, int*);
+void workq_close(struct workq*);
+
+// thread.c
+int thread_create(void (*)(void*), void*);
+int thread_join(int);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+
+// stdio.c
+extern FILE *stdin, *stdout, *stderr;
+FILE* fopen(const char*, const char*);
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int fread(void*, uint, uint, FILE*);
+int fwrite(const void*, uint, uint, FILE*);
+int fgetc(FILE*);
+int fputc(int, FILE*);
+char* fgets(char*, int, FILE*);
+char* gets(char*, int max);
+int feof(FILE*);
+int ferror(FILE*);
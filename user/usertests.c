@@ -7,6 +7,9 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/uio.h"
+#include "kernel/spawn.h"
+#include "kernel/futex.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -570,6 +573,62 @@ writetest(char *s)
   }
 }
 
+// writev() and pwrite() put bytes where readv() and pread()
+// expect them, and pread()/pwrite() leave the file offset alone.
+void
+iovtest(char *s)
+{
+  struct iovec iov[3];
+  char a[10], b[20], c[30];
+  int fd, i;
+
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create iovfile failed\n", s);
+    exit(1);
+  }
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  iov[0].iov_base = a; iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b; iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = c; iov[2].iov_len = sizeof(c);
+  if(writev(fd, iov, 3) != 60){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "xy", 2, 9) != 2 || write(fd, "z", 1) != 1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, c, 4, 8) != 4 || c[0] != 'a' || c[1] != 'x' || c[2] != 'y' || c[3] != 'b'){
+    printf("%s: pread returned wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("iovfile", O_RDONLY);
+  if(readv(fd, iov, 3) != 60 || read(fd, a, 1) != 1 || a[0] != 'z'){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(b); i++){
+    if(b[i] != (i == 0 ? 'y' : 'b')){
+      printf("%s: readv returned wrong data\n", s);
+      exit(1);
+    }
+  }
+
+  // lengths adding up to more than readv() can return.
+  iov[0].iov_len = iov[1].iov_len = 1L << 30;
+  if(readv(fd, iov, 2) != -1){
+    printf("%s: readv of 2GB succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("iovfile");
+}
+
 void
 writebig(char *s)
 {
@@ -581,205 +640,1120 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
-    ((int*)buf)[0] = i;
-    if(write(fd, buf, BSIZE) != BSIZE){
-      printf("%s: error: write big file failed\n", i);
+  for(i = 0; i < MAXFILE; i++){
+    ((int*)buf)[0] = i;
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: error: write big file failed\n", i);
+      exit(1);
+    }
+  }
+
+  close(fd);
+
+  fd = open("big", O_RDONLY);
+  if(fd < 0){
+    printf("%s: error: open big failed!\n", s);
+    exit(1);
+  }
+
+  n = 0;
+  for(;;){
+    i = read(fd, buf, BSIZE);
+    if(i == 0){
+      if(n == MAXFILE - 1){
+        printf("%s: read only %d blocks from big", n);
+        exit(1);
+      }
+      break;
+    } else if(i != BSIZE){
+      printf("%s: read failed %d\n", i);
+      exit(1);
+    }
+    if(((int*)buf)[0] != n){
+      printf("%s: read content of block %d is %d\n",
+             n, ((int*)buf)[0]);
+      exit(1);
+    }
+    n++;
+  }
+  close(fd);
+  if(unlink("big") < 0){
+    printf("%s: unlink big failed\n", s);
+    exit(1);
+  }
+}
+
+// many creates, followed by unlink test
+void
+createtest(char *s)
+{
+  int i, fd;
+  enum { N=52 };
+
+  name[0] = 'a';
+  name[2] = '\0';
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i;
+    fd = open(name, O_CREATE|O_RDWR);
+    close(fd);
+  }
+  name[0] = 'a';
+  name[2] = '\0';
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i;
+    unlink(name);
+  }
+}
+
+void dirtest(char *s)
+{
+  printf("mkdir test\n");
+
+  if(mkdir("dir0") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+
+  if(chdir("dir0") < 0){
+    printf("%s: chdir dir0 failed\n", s);
+    exit(1);
+  }
+
+  if(chdir("..") < 0){
+    printf("%s: chdir .. failed\n", s);
+    exit(1);
+  }
+
+  if(unlink("dir0") < 0){
+    printf("%s: unlink dir0 failed\n", s);
+    exit(1);
+  }
+  printf("%s: mkdir test ok\n");
+}
+
+void
+exectest(char *s)
+{
+  int fd, xstatus, pid;
+  char *echoargv[] = { "echo", "OK", 0 };
+  char buf[3];
+
+  unlink("echo-ok");
+  pid = fork();
+  if(pid < 0) {
+     printf("%s: fork failed\n", s);
+     exit(1);
+  }
+  if(pid == 0) {
+    close(1);
+    fd = open("echo-ok", O_CREATE|O_WRONLY);
+    if(fd < 0) {
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    if(fd != 1) {
+      printf("%s: wrong fd\n", s);
+      exit(1);
+    }
+    if(exec("echo", echoargv) < 0){
+      printf("%s: exec echo failed\n", s);
+      exit(1);
+    }
+    // won't get to here
+  }
+  if (wait(&xstatus) != pid) {
+    printf("%s: wait failed!\n", s);
+  }
+  if(xstatus != 0)
+    exit(xstatus);
+
+  fd = open("echo-ok", O_RDONLY);
+  if(fd < 0) {
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if (read(fd, buf, 2) != 2) {
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  unlink("echo-ok");
+  if(buf[0] == 'O' && buf[1] == 'K')
+    exit(0);
+  else {
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+
+}
+
+// simple fork and pipe read/write
+
+void
+pipe1(char *s)
+{
+  int fds[2], pid, xstatus;
+  int seq, i, n, cc, total;
+  enum { N=5, SZ=1033 };
+  
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < N; n++){
+      for(i = 0; i < SZ; i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, SZ) != SZ){
+        printf("%s: pipe1 oops 1\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  } else if(pid > 0){
+    close(fds[1]);
+    total = 0;
+    cc = 1;
+    while((n = read(fds[0], buf, cc)) > 0){
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (seq++ & 0xff)){
+          printf("%s: pipe1 oops 2\n", s);
+          return;
+        }
+      }
+      total += n;
+      cc = cc * 2;
+      if(cc > sizeof(buf))
+        cc = sizeof(buf);
+    }
+    if(total != N * SZ){
+      printf("%s: pipe1 oops 3 total %d\n", total);
+      exit(1);
+    }
+    close(fds[0]);
+    wait(&xstatus);
+    exit(xstatus);
+  } else {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+}
+
+// pages of a mapped file read in on demand, and writes to a
+// MAP_SHARED mapping (but not a MAP_PRIVATE one) reach the file.
+void
+mmaptest(char *s)
+{
+  char buf[16], *p;
+  int fd, i;
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*PGSIZE/sizeof(buf); i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    write(fd, buf, sizeof(buf));
+  }
+
+  p = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a' || p[PGSIZE+16] != 'a' + (PGSIZE/16 + 1) % 26){
+    printf("%s: wrong data in private mapping\n", s);
+    exit(1);
+  }
+  p[0] = 'X';
+  if(munmap(p, 2*PGSIZE) != 0){
+    printf("%s: munmap private failed\n", s);
+    exit(1);
+  }
+
+  p = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1 || p[0] != 'a'){
+    printf("%s: private write reached the file\n", s);
+    exit(1);
+  }
+  p[1] = 'Y';
+  if(munmap(p, PGSIZE) != 0 || munmap(p + PGSIZE, PGSIZE) != 0){
+    printf("%s: munmap shared failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 2, 0) != 2 || buf[0] != 'a' || buf[1] != 'Y'){
+    printf("%s: shared write did not reach the file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+}
+
+// sh < script must leave the lines after a command for that
+// command to read from its stdin.
+void
+shstdin(char *s)
+{
+  char *args[] = { "sh", 0 };
+  char buf[32];
+  int fd, n, pid, xstatus;
+
+  fd = open("shstdin.sh", O_CREATE|O_WRONLY|O_TRUNC);
+  if(fd < 0 || write(fd, "cat\nhello\n", 10) != 10){
+    printf("%s: create shstdin.sh failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(0);
+    close(1);
+    close(2);
+    if(open("shstdin.sh", O_RDONLY) != 0 ||
+       open("shstdin.out", O_CREATE|O_WRONLY|O_TRUNC) != 1 || dup(1) != 2)
+      exit(1);
+    exec("sh", args);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: sh failed\n", s);
+    exit(1);
+  }
+
+  fd = open("shstdin.out", O_RDONLY);
+  n = read(fd, buf, sizeof(buf)-1);
+  close(fd);
+  if(n < 0)
+    n = 0;
+  buf[n] = 0;
+  if(strcmp(buf, "$ hello\n$ ") != 0){
+    printf("%s: sh left cat %s\n", s, buf);
+    exit(1);
+  }
+  unlink("shstdin.sh");
+  unlink("shstdin.out");
+}
+
+// read() and write() of a file to and from untouched pages of
+// its own mapping must fault them in before locking the file.
+void
+mmapself(char *s)
+{
+  char buf[PGSIZE/8], *p;
+  int fd, fd2, i;
+
+  fd = open("mmapself", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create mmapself failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*PGSIZE/sizeof(buf); i++){
+    memset(buf, i < PGSIZE/sizeof(buf) ? 'a' : 'b', sizeof(buf));
+    write(fd, buf, sizeof(buf));
+  }
+  p = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+
+  // append the first page, from the mapping.
+  if(write(fd, p, PGSIZE) != PGSIZE){
+    printf("%s: write from own mapping failed\n", s);
+    exit(1);
+  }
+  // read the file's start into the second page.
+  if((fd2 = open("mmapself", O_RDONLY)) < 0 || read(fd2, p + PGSIZE, 16) != 16){
+    printf("%s: read into own mapping failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  if(p[PGSIZE] != 'a' || p[PGSIZE+15] != 'a' || p[PGSIZE+16] != 'b'){
+    printf("%s: wrong data in mapping after read\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, sizeof(buf), 2*PGSIZE) != sizeof(buf) || buf[0] != 'a'){
+    printf("%s: wrong data written from mapping\n", s);
+    exit(1);
+  }
+
+  // munmap() writes back the second page, written by read(),
+  // but not the first, only read, over a later write().
+  if(pwrite(fd, "zz", 2, 100) != 2){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  munmap(p, 2*PGSIZE);
+  if(pread(fd, buf, 2, 100) != 2 || buf[0] != 'z' || buf[1] != 'z'){
+    printf("%s: munmap wrote back a page only read\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 1, PGSIZE) != 1 || buf[0] != 'a'){
+    printf("%s: munmap lost a page written by read()\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapself");
+}
+
+// spawn() starts a program with its file actions carried out:
+// echo's output goes to a file, then down a pipe.
+void
+spawntest(char *s)
+{
+  char *args[] = { "echo", "spawned", 0 };
+  struct spawnact act[3];
+  char buf[16];
+  int fd, p[2], i, n, xstatus;
+
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 1;
+  act[0].omode = O_CREATE|O_WRONLY;
+  act[0].path = "spawnout";
+  if(spawn("echo", args, act, 1) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: echo failed\n", s);
+    exit(1);
+  }
+  fd = open("spawnout", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output in file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("spawnout");
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 1;
+  act[0].srcfd = p[1];
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = p[0];
+  act[2].op = SPAWN_CLOSE;
+  act[2].fd = p[1];
+  if(spawn("echo", args, act, 3) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(p[1]);
+  for(n = 0; n < sizeof(buf) && (i = read(p[0], buf + n, sizeof(buf) - n)) > 0; n += i)
+    ;
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output from pipe\n", s);
+    exit(1);
+  }
+  close(p[0]);
+  wait(0);
+
+  if(spawn("nosuchprogram", args, 0, 0) >= 0){
+    printf("%s: spawn of missing program succeeded\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_CLOSE;
+  act[0].fd = NOFILEMAX;
+  if(spawn("echo", args, act, 1) >= 0){
+    printf("%s: spawn with bad fd succeeded\n", s);
+    exit(1);
+  }
+}
+
+// A vfork() child runs in its parent's memory, and the parent
+// waits until the child exits or execs.
+void
+vforktest(char *s)
+{
+  static volatile int shared;
+  char *args[] = { "echo", 0 };
+  char *top;
+  int pid, xstatus;
+
+  shared = 0;
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    shared = 1;
+    exit(7);
+  }
+  if(shared != 1){
+    printf("%s: parent did not see the child's store\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: wrong exit status %d\n", s, xstatus);
+    exit(1);
+  }
+
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    exec("echo", args);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: vfork then exec failed\n", s);
+    exit(1);
+  }
+
+  // the child can't touch heap the parent has no page-table
+  // pages for yet; it must die, not leave the kernel to
+  // free page-table pages it made in its own root.
+  top = sbrk((1 << 30) + PGSIZE);
+  if(top == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  top += (1 << 30);
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *top = 1;
+    exit(0);
+  }
+  if(wait(&xstatus) != pid || xstatus != -1){
+    printf("%s: vfork child touched unmapped heap\n", s);
+    exit(1);
+  }
+  sbrk(-((1 << 30) + PGSIZE));
+}
+
+static struct mutex clonelock;
+static int clonecount;
+
+static void
+cloneinc(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&clonelock);
+    clonecount++;
+    mutex_unlock(&clonelock);
+  }
+}
+
+static void
+clonespin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+// Threads share memory and are joined; a process whose first
+// thread exits takes its other threads with it.
+void
+clonetest(char *s)
+{
+  int i, pid, xstatus, tid[4];
+
+  clonecount = 0;
+  for(i = 0; i < 4; i++){
+    if((tid[i] = thread_create(cloneinc, 0)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join(tid[i]) < 0){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(clonecount != 4000){
+    printf("%s: count %d, not 4000\n", s, clonecount);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(thread_create(clonespin, 0) < 0)
+      exit(1);
+    exit(5);
+  }
+  if(wait(&xstatus) != pid || xstatus != 5){
+    printf("%s: process with a spinning thread did not exit\n", s);
+    exit(1);
+  }
+
+  // a futex wait for a value that isn't there returns at once.
+  i = 1;
+  if(futex(&i, FUTEX_WAIT, 0) != -1){
+    printf("%s: futex wait on a stale value slept\n", s);
+    exit(1);
+  }
+}
+
+static int closefds[2], closeread;
+
+static void
+closereader(void *arg)
+{
+  char c;
+
+  closeread = read(closefds[0], &c, 1);
+}
+
+// A thread's read() keeps its file open while another thread
+// closes the descriptor it read from.
+void
+closetest(char *s)
+{
+  int tid;
+
+  if(pipe(closefds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  closeread = -2;
+  if((tid = thread_create(closereader, 0)) < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  if(close(closefds[0]) < 0){
+    printf("%s: close failed\n", s);
+    exit(1);
+  }
+  if(write(closefds[1], "x", 1) != 1){
+    printf("%s: write to pipe being read failed\n", s);
+    exit(1);
+  }
+  thread_join(tid);
+  if(closeread != 1){
+    printf("%s: read returned %d\n", s, closeread);
+    exit(1);
+  }
+  close(closefds[1]);
+}
+
+// Named semaphores block across processes, and the barrier and
+// work queue in ulib.c built on them work.
+void
+semtest(char *s)
+{
+  struct barrier b;
+  struct workq q;
+  int i, me, pid, sem, x, sum, xstatus;
+
+  if((sem = semopen("semtest", 0)) < 0){
+    printf("%s: semopen failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // a separate open finds the same semaphore.
+    if((sem = semopen("semtest", 5)) < 0)
+      exit(1);
+    sleep(1);
+    sempost(sem);
+    exit(0);
+  }
+  if(semwait(sem) != 0){
+    printf("%s: semwait failed\n", s);
+    exit(1);
+  }
+  wait(0);
+  close(sem);
+
+  if(barrier_init(&b, "semtestb", 3) < 0){
+    printf("%s: barrier_init failed\n", s);
+    exit(1);
+  }
+  for(me = 1; me < 3; me++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      break;
+  }
+  if(me == 3)
+    me = 0;
+  for(i = 0; i < 10; i++){
+    if(barrier_wait(&b, me) < 0){
+      printf("%s: barrier_wait failed\n", s);
+      exit(1);
+    }
+  }
+  if(me != 0)
+    exit(0);
+  for(i = 1; i < 3; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: barrier member failed\n", s);
+      exit(1);
+    }
+  }
+  barrier_close(&b);
+
+  if(workq_init(&q, "semtestq") < 0){
+    printf("%s: workq_init failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      sum = 0;
+      while(workq_get(&q, &x) == 0 && x >= 0)
+        sum += x;
+      exit(sum);
+    }
+  }
+  for(i = 1; i <= 100; i++)
+    workq_put(&q, i);
+  workq_put(&q, -1);
+  workq_put(&q, -1);
+  sum = 0;
+  for(i = 0; i < 2; i++){
+    wait(&xstatus);
+    sum += xstatus;
+  }
+  workq_close(&q);
+  unlink("semtestq");
+  if(sum != 5050){
+    printf("%s: work queue sum %d, not 5050\n", s, sum);
+    exit(1);
+  }
+}
+
+// Blocks of every size class, and large ones, don't overlap,
+// and freeing them all gives back every byte.
+void
+malloctest(char *s)
+{
+  struct mallocstat st0, st1;
+  char *p[64];
+  int i, j, n;
+
+  mallocstat(&st0);
+  for(i = 0; i < 64; i++){
+    n = 1 + i * 97;
+    if((p[i] = malloc(n)) == 0){
+      printf("%s: malloc(%d) failed\n", s, n);
+      exit(1);
+    }
+    memset(p[i], i, n);
+  }
+  for(i = 0; i < 64; i++){
+    n = 1 + i * 97;
+    for(j = 0; j < n; j++){
+      if(p[i][j] != i){
+        printf("%s: block %d was overwritten\n", s, i);
+        exit(1);
+      }
+    }
+  }
+  for(i = 0; i < 64; i += 2)
+    free(p[i]);
+  for(i = 1; i < 64; i += 2)
+    free(p[i]);
+  mallocstat(&st1);
+  if(st1.inuse != st0.inuse || st1.nmalloc - st0.nmalloc != 64 ||
+     st1.nfree - st0.nfree != 64){
+    printf("%s: stats don't add up\n", s);
+    exit(1);
+  }
+}
+
+// A negative sbrk() moves the break back exactly, madvise() drops
+// pages so they read back as zeros, and free() of a big block
+// hands memory back to the kernel.
+void
+shrinktest(char *s)
+{
+  struct mallocstat st0, st1;
+  char *a, *b, *p;
+  int i, pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a = sbrk(3*4096 + 123);
+    b = sbrk(0);
+    if(sbrk(-100) != b || sbrk(0) != b - 100){
+      printf("%s: sbrk(-100) left the break at %p, not %p\n", s, sbrk(0), b - 100);
+      exit(1);
+    }
+    p = (char*)(((uint64)a + 4095) & ~4095L);
+    memset(p, 'x', 2*4096);
+    if(madvise(p, 2*4096, MADV_DONTNEED) < 0){
+      printf("%s: madvise failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < 2*4096; i++){
+      if(p[i] != 0){
+        printf("%s: page not zero after madvise\n", s);
+        exit(1);
+      }
+    }
+    if(madvise(p + 1, 4096, MADV_DONTNEED) == 0 ||
+       madvise(b + 8*4096, 4096, MADV_DONTNEED) == 0){
+      printf("%s: madvise accepted a bad range\n", s);
+      exit(1);
+    }
+    sbrk(-(sbrk(0) - a));
+
+    if((p = malloc(1024*1024)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+    memset(p, 1, 1024*1024);
+    mallocstat(&st0);
+    free(p);
+    mallocstat(&st1);
+    if(st1.heap >= st0.heap){
+      printf("%s: free() kept all %d bytes of heap\n", s, st0.heap);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+}
+
+// Processes between them can hold more open files than the
+// old fixed file table had room for.
+void
+manyfiles(char *s)
+{
+  enum { NCHILD = 12, NPIPE = 5 };
+  int hold[2], res[2], fds[2];
+  int i, j, pid, xstatus;
+  char c;
+
+  if(pipe(hold) < 0 || pipe(res) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(hold[1]);
+      close(res[0]);
+      c = 'y';
+      for(j = 0; j < NPIPE; j++)
+        if(pipe(fds) < 0)
+          c = 'n';
+      write(res[1], &c, 1);
+      read(hold[0], &c, 1);  // until the parent lets go
+      exit(0);
+    }
+  }
+  close(hold[0]);
+  close(res[1]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(res[0], &c, 1) != 1 || c != 'y'){
+      printf("%s: child could not make %d pipes\n", s, NPIPE);
+      exit(1);
+    }
+  }
+  close(hold[1]);
+  close(res[0]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
+// A process can have more than NOFILE descriptors, up to
+// NOFILEMAX; dup() gives the lowest free one, and fork()
+// copies the whole table.
+void
+manyfds(char *s)
+{
+  int fd, i, n, pid, xstatus;
+  char c;
+
+  if((fd = open("README", O_RDONLY)) < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  for(n = fd + 1; (i = dup(fd)) >= 0; n++){
+    if(i != n){
+      printf("%s: dup gave %d, not %d\n", s, i, n);
+      exit(1);
+    }
+  }
+  if(n != NOFILEMAX){
+    printf("%s: only %d descriptors\n", s, n);
+    exit(1);
+  }
+  close(100);
+  close(50);
+  if(dup(fd) != 50 || dup(fd) != 100){
+    printf("%s: dup didn't reuse the lowest descriptor\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(read(NOFILEMAX - 1, &c, 1) != 1)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child couldn't read its last descriptor\n", s);
+    exit(1);
+  }
+  for(i = fd; i < NOFILEMAX; i++)
+    close(i);
+}
+
+// Readers of one file run together, each seeing the right data,
+// and readers sharing a file descriptor still get each byte once.
+void
+sharedread(char *s)
+{
+  enum { N = 4, SZ = 4096 };
+  static char buf[SZ];
+  int fd, i, j, n, pid, xstatus, total;
+  int p[2];
+
+  unlink("sharedread");
+  if((fd = open("sharedread", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 23;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(j = 0; j < 20; j++){
+        if((fd = open("sharedread", O_RDONLY)) < 0)
+          exit(1);
+        memset(buf, 0, SZ);
+        if(read(fd, buf, SZ) != SZ)
+          exit(1);
+        for(n = 0; n < SZ; n++)
+          if(buf[n] != 'a' + n % 23)
+            exit(1);
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < N; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: a reader saw the wrong data\n", s);
       exit(1);
     }
   }
 
-  close(fd);
-
-  fd = open("big", O_RDONLY);
-  if(fd < 0){
-    printf("%s: error: open big failed!\n", s);
+  // readers sharing one offset.
+  if((fd = open("sharedread", O_RDONLY)) < 0 || pipe(p) < 0){
+    printf("%s: open failed\n", s);
     exit(1);
   }
-
-  n = 0;
-  for(;;){
-    i = read(fd, buf, BSIZE);
-    if(i == 0){
-      if(n == MAXFILE - 1){
-        printf("%s: read only %d blocks from big", n);
-        exit(1);
-      }
-      break;
-    } else if(i != BSIZE){
-      printf("%s: read failed %d\n", i);
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
       exit(1);
     }
-    if(((int*)buf)[0] != n){
-      printf("%s: read content of block %d is %d\n",
-             n, ((int*)buf)[0]);
+    if(pid == 0){
+      for(n = 0; (j = read(fd, buf, 7)) > 0; n += j)
+        ;
+      write(p[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(p[1]);
+  total = 0;
+  for(i = 0; i < N; i++){
+    wait(0);
+    if(read(p[0], &n, sizeof(n)) != sizeof(n)){
+      printf("%s: lost a reader\n", s);
       exit(1);
     }
-    n++;
+    total += n;
   }
+  close(p[0]);
   close(fd);
-  if(unlink("big") < 0){
-    printf("%s: unlink big failed\n", s);
+  if(total != SZ){
+    printf("%s: shared readers read %d bytes of %d\n", s, total, SZ);
     exit(1);
   }
+  unlink("sharedread");
 }
 
-// many creates, followed by unlink test
+// sleepstat() counts sleep-lock acquires, and no more of them
+// waited than there were.
 void
-createtest(char *s)
+lockstat(char *s)
 {
+  struct sleepstat st0, st1;
+  char buf[16];
   int i, fd;
-  enum { N=52 };
-
-  name[0] = 'a';
-  name[2] = '\0';
-  for(i = 0; i < N; i++){
-    name[1] = '0' + i;
-    fd = open(name, O_CREATE|O_RDWR);
-    close(fd);
-  }
-  name[0] = 'a';
-  name[2] = '\0';
-  for(i = 0; i < N; i++){
-    name[1] = '0' + i;
-    unlink(name);
-  }
-}
-
-void dirtest(char *s)
-{
-  printf("mkdir test\n");
 
-  if(mkdir("dir0") < 0){
-    printf("%s: mkdir failed\n", s);
+  if((fd = open("README", O_RDONLY)) < 0){
+    printf("%s: open README failed\n", s);
     exit(1);
   }
-
-  if(chdir("dir0") < 0){
-    printf("%s: chdir dir0 failed\n", s);
+  if(sleepstat(&st0) < 0){
+    printf("%s: sleepstat failed\n", s);
     exit(1);
   }
-
-  if(chdir("..") < 0){
-    printf("%s: chdir .. failed\n", s);
+  for(i = 0; i < 10; i++)
+    pread(fd, buf, sizeof(buf), 0);
+  sleepstat(&st1);
+  close(fd);
+  if(st1.shared - st0.shared < 10 || st1.acquire - st0.acquire < 10){
+    printf("%s: 10 reads counted as %d shared, %d exclusive acquires\n", s,
+           (int)(st1.shared - st0.shared), (int)(st1.acquire - st0.acquire));
     exit(1);
   }
-
-  if(unlink("dir0") < 0){
-    printf("%s: unlink dir0 failed\n", s);
+  if(st1.spin + st1.sleep > st1.acquire + st1.shared){
+    printf("%s: more waits than acquires\n", s);
     exit(1);
   }
-  printf("%s: mkdir test ok\n");
 }
 
+// wait() returns each child once, with its own status, and
+// then -1; kill() of a pid that is gone fails.
 void
-exectest(char *s)
+waitall(char *s)
 {
-  int fd, xstatus, pid;
-  char *echoargv[] = { "echo", "OK", 0 };
-  char buf[3];
+  enum { N = 20 };
+  int pids[N], seen[N];
+  int i, j, pid, xstatus;
 
-  unlink("echo-ok");
-  pid = fork();
-  if(pid < 0) {
-     printf("%s: fork failed\n", s);
-     exit(1);
-  }
-  if(pid == 0) {
-    close(1);
-    fd = open("echo-ok", O_CREATE|O_WRONLY);
-    if(fd < 0) {
-      printf("%s: create failed\n", s);
-      exit(1);
-    }
-    if(fd != 1) {
-      printf("%s: wrong fd\n", s);
+  for(i = 0; i < N; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
       exit(1);
     }
-    if(exec("echo", echoargv) < 0){
-      printf("%s: exec echo failed\n", s);
+    if(pids[i] == 0)
+      exit(i);
+    seen[i] = 0;
+  }
+  for(i = 0; i < N; i++){
+    pid = wait(&xstatus);
+    for(j = 0; j < N && pids[j] != pid; j++)
+      ;
+    if(j == N || seen[j] || xstatus != j){
+      printf("%s: wait returned pid %d status %d\n", s, pid, xstatus);
       exit(1);
     }
-    // won't get to here
-  }
-  if (wait(&xstatus) != pid) {
-    printf("%s: wait failed!\n", s);
-  }
-  if(xstatus != 0)
-    exit(xstatus);
-
-  fd = open("echo-ok", O_RDONLY);
-  if(fd < 0) {
-    printf("%s: open failed\n", s);
-    exit(1);
+    seen[j] = 1;
   }
-  if (read(fd, buf, 2) != 2) {
-    printf("%s: read failed\n", s);
+  if(wait(0) != -1){
+    printf("%s: wait with no children didn't fail\n", s);
     exit(1);
   }
-  unlink("echo-ok");
-  if(buf[0] == 'O' && buf[1] == 'K')
-    exit(0);
-  else {
-    printf("%s: wrong output\n", s);
+  if(kill(pids[0]) != -1){
+    printf("%s: kill of a reaped child succeeded\n", s);
     exit(1);
   }
-
 }
 
-// simple fork and pipe read/write
-
+// vmsplice() must deliver the same bytes as write()/read(),
+// and a page given to a pipe reads back as zeros.
 void
-pipe1(char *s)
+splicetest(char *s)
 {
-  int fds[2], pid, xstatus;
-  int seq, i, n, cc, total;
-  enum { N=5, SZ=1033 };
-  
+  int fds[2], i;
+  char *p;
+
+  p = sbrk(3*PGSIZE);
+  p += PGSIZE - (uint64)p % PGSIZE;
   if(pipe(fds) != 0){
     printf("%s: pipe() failed\n", s);
     exit(1);
   }
-  pid = fork();
-  seq = 0;
-  if(pid == 0){
-    close(fds[0]);
-    for(n = 0; n < N; n++){
-      for(i = 0; i < SZ; i++)
-        buf[i] = seq++;
-      if(write(fds[1], buf, SZ) != SZ){
-        printf("%s: pipe1 oops 1\n", s);
-        exit(1);
-      }
-    }
-    exit(0);
-  } else if(pid > 0){
-    close(fds[1]);
-    total = 0;
-    cc = 1;
-    while((n = read(fds[0], buf, cc)) > 0){
-      for(i = 0; i < n; i++){
-        if((buf[i] & 0xff) != (seq++ & 0xff)){
-          printf("%s: pipe1 oops 2\n", s);
-          return;
-        }
-      }
-      total += n;
-      cc = cc * 2;
-      if(cc > sizeof(buf))
-        cc = sizeof(buf);
-    }
-    if(total != N * SZ){
-      printf("%s: pipe1 oops 3 total %d\n", total);
+  for(i = 0; i < PGSIZE; i++)
+    p[i] = i % 251;
+  if(vmsplice(fds[1], p, PGSIZE) != PGSIZE){
+    printf("%s: vmsplice write failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 0 || p[PGSIZE-1] != 0){
+    printf("%s: spliced page not zero\n", s);
+    exit(1);
+  }
+  if(read(fds[0], p + PGSIZE, PGSIZE) != PGSIZE){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < PGSIZE; i++){
+    if(p[PGSIZE + i] != (char)(i % 251)){
+      printf("%s: wrong byte %d after vmsplice write\n", s, i);
       exit(1);
     }
-    close(fds[0]);
-    wait(&xstatus);
-    exit(xstatus);
-  } else {
-    printf("%s: fork() failed\n", s);
+  }
+  if(write(fds[1], p + PGSIZE, PGSIZE) != PGSIZE ||
+     vmsplice(fds[0], p, PGSIZE) != PGSIZE){
+    printf("%s: write/vmsplice read failed\n", s);
     exit(1);
   }
+  for(i = 0; i < PGSIZE; i++){
+    if(p[i] != (char)(i % 251)){
+      printf("%s: wrong byte %d after vmsplice read\n", s, i);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
 }
 
 // meant to be run w/ at most two CPUs
@@ -1526,6 +2500,54 @@ bigdir(char *s)
   }
 }
 
+// a directory with more entries than fit a one-page lookup
+// index still finds each of them.
+void
+hugedir(char *s)
+{
+  enum { N = 1000 };
+  int i, fd;
+  char name[8];
+
+  if(mkdir("hd") < 0 || (fd = open("hd/f", O_CREATE)) < 0){
+    printf("%s: hugedir create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  name[0] = 'h';
+  name[1] = 'd';
+  name[2] = '/';
+  name[3] = 'x';
+  name[7] = '\0';
+  for(i = 0; i < N; i++){
+    name[4] = '0' + (i / 100);
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + (i % 10);
+    if(link("hd/f", name) != 0){
+      printf("%s: link(hd/f, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    name[4] = '0' + (i / 100);
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + (i % 10);
+    if(link("hd/f", name) == 0){
+      printf("%s: %s linked twice\n", s, name);
+      exit(1);
+    }
+    if(unlink(name) != 0){
+      printf("%s: unlink(%s) failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("hd/f") != 0 || unlink("hd") != 0){
+    printf("%s: hugedir unlink failed\n", s);
+    exit(1);
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -1959,6 +2981,70 @@ iref(char *s)
   chdir("/");
 }
 
+// repeated lookups should hit the name cache, and creating
+// or removing a name must not leave a stale entry behind.
+void
+dcache(char *s)
+{
+  struct dcachestat st0, st1;
+  int i, fd;
+
+  if(mkdir("dcd") != 0){
+    printf("%s: mkdir dcd failed\n", s);
+    exit(1);
+  }
+  if(open("dcd/f", 0) >= 0){
+    printf("%s: open dcd/f succeeded before create\n", s);
+    exit(1);
+  }
+  fd = open("dcd/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create dcd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(dcachestat(&st0) < 0){
+    printf("%s: dcachestat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    fd = open("dcd/f", 0);
+    if(fd < 0){
+      printf("%s: open dcd/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  dcachestat(&st1);
+  if(st1.hits - st0.hits < 10){
+    printf("%s: only %d cache hits for 10 lookups\n", s, (int)(st1.hits - st0.hits));
+    exit(1);
+  }
+
+  if(unlink("dcd/f") != 0){
+    printf("%s: unlink dcd/f failed\n", s);
+    exit(1);
+  }
+  if(open("dcd/f", 0) >= 0){
+    printf("%s: open dcd/f succeeded after unlink\n", s);
+    exit(1);
+  }
+  if(unlink("dcd") != 0){
+    printf("%s: unlink dcd failed\n", s);
+    exit(1);
+  }
+  if(open("dcd/f", 0) >= 0 || mkdir("dcd") != 0){
+    printf("%s: dcd lookups wrong after unlink\n", s);
+    exit(1);
+  }
+  if(open("dcd/f", 0) >= 0){
+    printf("%s: dcd/f found in new dcd\n", s);
+    exit(1);
+  }
+  unlink("dcd");
+}
+
 // test that fork fails gracefully
 // the forktest binary also does this, but it runs out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
@@ -2727,12 +3813,29 @@ main(int argc, char *argv[])
     {opentest, "opentest"},
     {writetest, "writetest"},
     {writebig, "writebig"},
+    {iovtest, "iov"},
     {createtest, "createtest"},
     {openiputtest, "openiput"},
     {exitiputtest, "exitiput"},
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {splicetest, "vmsplice"},
+    {mmaptest, "mmap"},
+    {mmapself, "mmapself"},
+    {shstdin, "shstdin"},
+    {spawntest, "spawn"},
+    {vforktest, "vfork"},
+    {clonetest, "clone"},
+    {closetest, "closethread"},
+    {semtest, "sem"},
+    {malloctest, "malloc"},
+    {shrinktest, "shrink"},
+    {manyfiles, "manyfiles"},
+    {manyfds, "manyfds"},
+    {sharedread, "sharedread"},
+    {lockstat, "lockstat"},
+    {waitall, "waitall"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -2740,8 +3843,10 @@ main(int argc, char *argv[])
     {bigfile, "bigfile"},
     {dirfile, "dirfile"},
     {iref, "iref"},
+    {dcache, "dcache"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
+    {hugedir, "hugedir"}, // slow
     { 0, 0},
   };
 
@@ -6,24 +6,27 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# fork, exec, exit and spawn get stubs named _fork etc.;
+# ulib.c wraps them to flush stdio buffers first.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -36,3 +39,23 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("dcachestat");
+entry("pipesize");
+entry("vmsplice");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("ringsetup");
+entry("ringenter");
+entry("mmap");
+entry("munmap");
+entry("vfork");
+entry("clone");
+entry("futex");
+entry("semopen");
+entry("semwait");
+entry("sempost");
+entry("madvise");
+entry("sleepstat");
+entry("spawn", "_spawn");